@@ -0,0 +1,147 @@
+#ifndef MODBUS_BIT_PACKING_HPP
+#define MODBUS_BIT_PACKING_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace modbus {
+namespace tcp {
+
+// Bulk conversion between one byte per value (zero / non-zero) and the packed coil format on the
+// wire, where value i is bit (i % 8) of byte (i / 8). Unused bits of the last packed byte are zero.
+inline void                             packBits(const uint8_t* values, std::size_t numBits, uint8_t* dst);
+inline void                             unpackBits(const uint8_t* src, std::size_t numBits, uint8_t* values);
+
+// Same, with the values held in 64 bit words, value i being bit (i % 64) of word (i / 64).
+inline void                             packBits(const uint64_t* words, std::size_t numBits, uint8_t* dst);
+inline void                             unpackBits(const uint8_t* src, std::size_t numBits, uint64_t* words);
+
+
+namespace bit_packing {
+
+inline uint8_t packByte(const uint8_t* values, std::size_t numBits) {
+    uint8_t byte = 0;
+
+    for (std::size_t bit = 0; bit < numBits; ++bit)
+        byte |= (values[bit] != 0) << bit;
+
+    return byte;
+}
+
+
+inline void unpackByte(uint8_t byte, std::size_t numBits, uint8_t* values) {
+    for (std::size_t bit = 0; bit < numBits; ++bit)
+        values[bit] = (byte >> bit) & 1;
+}
+
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+// 8 values -> 1 byte: fold each byte down to its lowest bit, then gather the 8 low bits into the
+// top byte with a single multiply.
+inline uint8_t packByte(const uint8_t* values) {
+    uint64_t x;
+    std::memcpy(&x, values, sizeof(x));
+
+    x |= x >> 4;
+    x |= x >> 2;
+    x |= x >> 1;
+    x &= 0x0101010101010101ULL;
+
+    return (x * 0x0102040810204080ULL) >> 56;
+}
+
+
+// 1 byte -> 8 values: broadcast the byte, keep bit i in byte i, then turn every non-zero byte into 1.
+inline void unpackByte(uint8_t byte, uint8_t* values) {
+    uint64_t x = (byte * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+    x = ((x + 0x7F7F7F7F7F7F7F7FULL) & 0x8080808080808080ULL) >> 7;
+
+    std::memcpy(values, &x, sizeof(x));
+}
+
+#else
+
+inline uint8_t packByte(const uint8_t* values) {
+    return packByte(values, 8);
+}
+
+
+inline void unpackByte(uint8_t byte, uint8_t* values) {
+    unpackByte(byte, 8, values);
+}
+
+#endif
+
+} // namespace bit_packing
+
+
+void packBits(const uint8_t* values, std::size_t numBits, uint8_t* dst) {
+    std::size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= numBits; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        uint16_t mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+
+        dst[i / 8] = mask & 0xff;
+        dst[i / 8 + 1] = mask >> 8;
+    }
+#endif
+
+    for (; i + 8 <= numBits; i += 8)
+        dst[i / 8] = bit_packing::packByte(values + i);
+
+    if (i < numBits)
+        dst[i / 8] = bit_packing::packByte(values + i, numBits - i);
+}
+
+
+void unpackBits(const uint8_t* src, std::size_t numBits, uint8_t* values) {
+    std::size_t i = 0;
+
+    for (; i + 8 <= numBits; i += 8)
+        bit_packing::unpackByte(src[i / 8], values + i);
+
+    if (i < numBits)
+        bit_packing::unpackByte(src[i / 8], numBits - i, values + i);
+}
+
+
+void packBits(const uint64_t* words, std::size_t numBits, uint8_t* dst) {
+    std::size_t numBytes = (numBits + 7) / 8;
+
+    for (std::size_t i = 0; i < numBytes; ++i)
+        dst[i] = words[i / 8] >> (8 * (i % 8));
+
+    if (numBits % 8 != 0)
+        dst[numBytes - 1] &= (1 << (numBits % 8)) - 1;
+}
+
+
+void unpackBits(const uint8_t* src, std::size_t numBits, uint64_t* words) {
+    std::size_t numBytes = (numBits + 7) / 8;
+    std::size_t numWords = (numBits + 63) / 64;
+
+    for (std::size_t i = 0; i < numWords; ++i)
+        words[i] = 0;
+
+    for (std::size_t i = 0; i < numBytes; ++i)
+        words[i / 8] |= static_cast<uint64_t>(src[i]) << (8 * (i % 8));
+
+    if (numBits % 64 != 0)
+        words[numWords - 1] &= (1ULL << (numBits % 64)) - 1;
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef MODBUS_BYTE_ORDER_HPP
+#define MODBUS_BYTE_ORDER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MODBUS_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+namespace modbus {
+namespace tcp {
+
+// Bulk conversion of register arrays between host order and the big endian wire format.
+// The wire side is a plain byte pointer, so it may point at an unaligned payload inside a frame.
+inline void                             encodeRegisters(const uint16_t* src, std::size_t numRegs, uint8_t* dst);
+inline void                             decodeRegisters(const uint8_t* src, std::size_t numRegs, uint16_t* dst);
+
+
+namespace byte_order {
+
+using SwapFunction                      = void (*)(const uint8_t* src, std::size_t numRegs, uint8_t* dst);
+
+
+inline void swapScalar(const uint8_t* src, std::size_t numRegs, uint8_t* dst) {
+    for (std::size_t i = 0; i < numRegs; ++i) {
+        uint8_t hi = src[2*i];
+        dst[2*i] = src[2*i + 1];
+        dst[2*i + 1] = hi;
+    }
+}
+
+
+#ifdef MODBUS_HAVE_X86_KERNELS
+
+__attribute__((target("ssse3")))
+inline void swapSsse3(const uint8_t* src, std::size_t numRegs, uint8_t* dst) {
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    std::size_t i = 0;
+
+    for (; i + 8 <= numRegs; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i), _mm_shuffle_epi8(v, mask));
+    }
+
+    swapScalar(src + 2*i, numRegs - i, dst + 2*i);
+}
+
+
+__attribute__((target("avx2")))
+inline void swapAvx2(const uint8_t* src, std::size_t numRegs, uint8_t* dst) {
+    const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    std::size_t i = 0;
+
+    for (; i + 16 <= numRegs; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2*i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2*i), _mm256_shuffle_epi8(v, mask));
+    }
+
+    swapSsse3(src + 2*i, numRegs - i, dst + 2*i);
+}
+
+#endif
+
+
+inline SwapFunction selectSwap() {
+#ifdef MODBUS_HAVE_X86_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return &swapAvx2;
+
+    if (__builtin_cpu_supports("ssse3"))
+        return &swapSsse3;
+#endif
+    return &swapScalar;
+}
+
+
+// resolved once, on first use
+inline void swap(const uint8_t* src, std::size_t numRegs, uint8_t* dst) {
+    static const SwapFunction impl = selectSwap();
+    impl(src, numRegs, dst);
+}
+
+} // namespace byte_order
+
+
+void encodeRegisters(const uint16_t* src, std::size_t numRegs, uint8_t* dst) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::memcpy(dst, src, 2*numRegs);
+#else
+    byte_order::swap(reinterpret_cast<const uint8_t*>(src), numRegs, dst);
+#endif
+}
+
+
+void decodeRegisters(const uint8_t* src, std::size_t numRegs, uint16_t* dst) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::memcpy(dst, src, 2*numRegs);
+#else
+    byte_order::swap(src, numRegs, reinterpret_cast<uint8_t*>(dst));
+#endif
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
@@ -9,8 +9,9 @@ namespace tcp {
 static const uint16_t   MODBUS_PROTOCOL_ID = 0;
 static const uint16_t   MODBUS_MAX_NUM_BITS_IN_READ_REQUEST = 0x07D0;
 static const uint8_t    MODBUS_MAX_NUM_REGS_IN_READ_REQUEST = 0x007D;
-static const uint16_t   MODBUS_MAX_NUM_BITS_IN_WRITE_REQUEST = 0x07D0;
-static const uint8_t    MODBUS_MAX_NUM_REGS_IN_WRITE_REQUEST = 0x007D;
+static const uint16_t   MODBUS_MAX_NUM_BITS_IN_WRITE_REQUEST = 0x07B0;
+static const uint8_t    MODBUS_MAX_NUM_REGS_IN_WRITE_REQUEST = 0x007B;
+static const uint16_t   MODBUS_MAX_ADU_LENGTH = 260;
 
 
 enum class FunctionCode : uint8_t {
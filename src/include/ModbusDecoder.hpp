@@ -3,6 +3,8 @@
 
 #include "ModbusConsts.hpp"
 #include "ModbusTypes.hpp"
+#include "ModbusByteOrder.hpp"
+#include "ModbusBitPacking.hpp"
 #include <arpa/inet.h>
 
 
@@ -53,6 +55,9 @@ public:
                                 ReadBitsRsp(const std::vector<uint8_t>& rx_buffer);
     uint8_t                     getNumBits() const;
     bool                        getBit(std::size_t pos) const;
+    void                        getBits(uint8_t* values, std::size_t numBits) const;
+    uint8_t                     getNumBytes() const;
+    const uint8_t*              getBytes() const;
 private:
     const modbus::tcp::ReadCoilsRsp *m_read_rsp;
 };
@@ -64,6 +69,7 @@ public:
                                 ReadRegistersRsp(const std::vector<uint8_t>& rx_buffer);
     uint16_t                    getNumRegs() const;
     uint16_t                    getRegister(uint16_t idx) const;
+    void                        getRegisters(uint16_t* regs) const;
 private:
     const modbus::tcp::ReadRegsRsp* m_read_rsp;
 };
@@ -113,6 +119,9 @@ public:
     modbus::tcp::Address        getStartAddress() const;
     modbus::tcp::NumBits        getNumBits() const;
     bool                        getCoil(uint16_t idx) const;
+    void                        getCoils(uint8_t* values) const;
+    uint8_t                     getNumBytes() const;
+    const uint8_t*              getBytes() const;
 private:
     const modbus::tcp::WriteCoilsReq* m_req;
 };
@@ -135,6 +144,8 @@ public:
     modbus::tcp::Address    getStartAddress() const;
     modbus::tcp::NumRegs    getNumRegs() const;
     uint16_t                getRegister(uint16_t idx) const;
+    void                    getRegisters(uint16_t* regs) const;
+    const uint8_t*          getBytes() const;
 
 private:
     const modbus::tcp::WriteRegistersReq* m_req;
@@ -296,6 +307,25 @@ bool ReadBitsRsp<dummy>::getBit(std::size_t pos) const {
 }
 
 
+// the response only carries a byte count, so the caller says how many of the packed bits it wants
+template <int dummy>
+void ReadBitsRsp<dummy>::getBits(uint8_t* values, std::size_t numBits) const {
+    unpackBits(m_read_rsp->coils, numBits, values);
+}
+
+
+template <int dummy>
+uint8_t ReadBitsRsp<dummy>::getNumBytes() const {
+    return m_read_rsp->numBytes;
+}
+
+
+template <int dummy>
+const uint8_t* ReadBitsRsp<dummy>::getBytes() const {
+    return m_read_rsp->coils;
+}
+
+
 template <int dummy>
 ReadRegistersRsp<dummy>::ReadRegistersRsp(const std::vector<uint8_t>& rx_buffer) :
     m_read_rsp(reinterpret_cast<const modbus::tcp::ReadRegsRsp*>(rx_buffer.data()))
@@ -314,6 +344,12 @@ uint16_t ReadRegistersRsp<dummy>::getRegister(uint16_t idx) const {
 }
 
 
+template <int dummy>
+void ReadRegistersRsp<dummy>::getRegisters(uint16_t* regs) const {
+    decodeRegisters(reinterpret_cast<const uint8_t*>(m_read_rsp->regs), getNumRegs(), regs);
+}
+
+
 WriteCoilsReq::WriteCoilsReq(const std::vector<uint8_t>& rx_buffer) :
     m_req(reinterpret_cast<const modbus::tcp::WriteCoilsReq*>(rx_buffer.data()))
 {}
@@ -338,6 +374,21 @@ bool WriteCoilsReq::getCoil(uint16_t idx) const {
 }
 
 
+void WriteCoilsReq::getCoils(uint8_t* values) const {
+    unpackBits(m_req->coils, ntohs(m_req->numBits), values);
+}
+
+
+uint8_t WriteCoilsReq::getNumBytes() const {
+    return m_req->numBytes;
+}
+
+
+const uint8_t* WriteCoilsReq::getBytes() const {
+    return m_req->coils;
+}
+
+
 WriteCoilsRsp::WriteCoilsRsp(const std::vector<uint8_t>& rx_buffer) :
     m_rsp(reinterpret_cast<const modbus::tcp::WriteValuesRsp*>(rx_buffer.data()))
 {}
@@ -373,6 +424,16 @@ uint16_t WriteRegistersReq::getRegister(uint16_t idx) const {
 }
 
 
+void WriteRegistersReq::getRegisters(uint16_t* regs) const {
+    decodeRegisters(reinterpret_cast<const uint8_t*>(m_req->regs), getNumRegs().get(), regs);
+}
+
+
+const uint8_t* WriteRegistersReq::getBytes() const {
+    return reinterpret_cast<const uint8_t*>(m_req->regs);
+}
+
+
 WriteRegistersRsp::WriteRegistersRsp(const std::vector<uint8_t>& rx_buffer) :
     m_rsp(reinterpret_cast<const modbus::tcp::WriteValuesRsp*>(rx_buffer.data()))
 {
@@ -3,7 +3,11 @@
 
 #include "ModbusConsts.hpp"
 #include "ModbusTypes.hpp"
+#include "ModbusByteOrder.hpp"
+#include "ModbusBitPacking.hpp"
 #include <arpa/inet.h>
+#include <iterator>
+#include <vector>
 
 namespace modbus {
 namespace tcp {
@@ -16,6 +20,15 @@ public:
     void                                setUnitId(const UnitId& unitId);
     void                                setTransactionId(const TransactionId& transactionId);
 
+    static constexpr std::size_t        readReqSize();
+    static constexpr std::size_t        writeSingleValueSize();
+    static constexpr std::size_t        writeCoilsReqSize(std::size_t numCoils);
+    static constexpr std::size_t        writeRegistersReqSize(std::size_t numRegs);
+    static constexpr std::size_t        readBitsRspSize(std::size_t numBits);
+    static constexpr std::size_t        readRegistersRspSize(std::size_t numRegs);
+    static constexpr std::size_t        writeValuesRspSize();
+    static constexpr std::size_t        errorRspSize();
+
     void                                encodeReadCoilsReq(const Address& startAddr, const NumBits& numBits, std::vector<uint8_t>& target) const;
     void                                encodeReadDiscreteInputsReq(const Address& startAddr, const NumBits& numBits, std::vector<uint8_t>& target) const;
     void                                encodeReadHoldingRegistersReq(const Address& startAddr, const NumRegs& numRegs, std::vector<uint8_t>& target) const;
@@ -46,14 +59,93 @@ public:
 
     void                                encodeErrorRsp(FunctionCode code, ExceptionCode ex, std::vector<uint8_t>& target) const;
 
+    // The overloads below encode into caller provided memory and return the number of bytes written.
+    // They throw BufferTooSmall if the message does not fit into capacity bytes.
+    std::size_t                         encodeReadCoilsReq(const Address& startAddr, const NumBits& numBits, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeReadDiscreteInputsReq(const Address& startAddr, const NumBits& numBits, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeReadHoldingRegistersReq(const Address& startAddr, const NumRegs& numRegs, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeReadInputRegistersReq(const Address& startAddr, const NumRegs& numRegs, uint8_t* target, std::size_t capacity) const;
+
+    std::size_t                         encodeWriteSingleCoilReq(const Address& address, bool value, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeWriteSingleRegisterReq(const Address& address, uint16_t value, uint8_t* target, std::size_t capacity) const;
+    template <typename Iterator>
+    std::size_t                         encodeWriteCoilsReq(const Address& startAddress, Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const;
+    template <typename Iterator>
+    std::size_t                         encodeWriteRegistersReq(const Address& startAddress, Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const;
+
+    template<typename Iterator>
+    std::size_t                         encodeReadCoilsRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const;
+    template<typename Iterator>
+    std::size_t                         encodeReadDiscreteInputsRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const;
+    template<typename Iterator>
+    std::size_t                         encodeReadHoldingRegistersRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const;
+    template<typename Iterator>
+    std::size_t                         encodeReadInputRegistersRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const;
+
+    std::size_t                         encodeWriteSingleCoilRsp(const Address& address, bool value, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeWriteSingleRegisterRsp(const Address& address, uint16_t value, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeWriteCoilsRsp(const Address& startAddress, const NumBits& numCoils, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeWriteRegistersRsp(const Address& startAddress, const NumRegs& numRegs, uint8_t* target, std::size_t capacity) const;
+
+    std::size_t                         encodeErrorRsp(FunctionCode code, ExceptionCode ex, uint8_t* target, std::size_t capacity) const;
+
+    // For read responses whose payload has already been written behind the header, e.g. copied from
+    // a store kept in wire format. Only the header is filled in, the full message size is returned.
+    std::size_t                         encodeReadBitsRspHeader(FunctionCode code, std::size_t numBits, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeReadRegistersRspHeader(FunctionCode code, std::size_t numRegs, uint8_t* target, std::size_t capacity) const;
+
 private:
-    void                                encodeReadReq(FunctionCode code, uint16_t startAddress, uint16_t numValues, std::vector<uint8_t>& buffer) const;
-    void                                encodeWriteSingleValue(FunctionCode code, uint16_t address, uint16_t numValues, std::vector<uint8_t>& buffer) const;
+    std::size_t                         encodeReadReq(FunctionCode code, uint16_t startAddress, uint16_t numValues, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeWriteSingleValue(FunctionCode code, uint16_t address, uint16_t numValues, uint8_t* target, std::size_t capacity) const;
+    std::size_t                         encodeWriteValuesRsp(FunctionCode code, uint16_t startAddress, uint16_t numValues, uint8_t* target, std::size_t capacity) const;
+
+    template <typename Iterator>
+    std::size_t                         encodeReadBitsRsp(Iterator begin, Iterator end, FunctionCode code, uint8_t* target, std::size_t capacity) const;
+    template <typename Iterator>
+    std::size_t                         encodeReadRegsRsp(Iterator begin, Iterator end, FunctionCode code, uint8_t* target, std::size_t capacity) const;
+
+    using SizeFunction                  = std::size_t (*)(std::size_t);
+
+    // Vector overloads size the target exactly for random access ranges and reserve a full ADU otherwise.
+    template <typename Iterator>
+    static std::size_t                  sizeHint(Iterator begin, Iterator end, SizeFunction size);
+    template <typename Iterator>
+    static std::size_t                  sizeHint(Iterator begin, Iterator end, SizeFunction size, std::random_access_iterator_tag);
+    template <typename Iterator>
+    static std::size_t                  sizeHint(Iterator begin, Iterator end, SizeFunction size, std::input_iterator_tag);
+
+    // Payload writers walk the range once and return the number of values written. The header is filled afterwards.
+    template <typename Iterator>
+    static std::size_t                  packBits(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity);
+    template <typename Iterator>
+    static std::size_t                  packBits(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::random_access_iterator_tag);
+    template <typename Iterator>
+    static std::size_t                  packBits(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::input_iterator_tag);
+
+    template <typename Iterator>
+    static std::size_t                  packRegisters(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity);
+    template <typename Iterator>
+    static std::size_t                  packRegisters(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::random_access_iterator_tag);
+    template <typename Iterator>
+    static std::size_t                  packRegisters(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::input_iterator_tag);
 
     template <typename Iterator>
-    void                                encodeReadBitsRsp(Iterator begin, Iterator end, FunctionCode code, std::vector<uint8_t>& buffer) const;
+    static void                         packBitRun(Iterator begin, std::size_t numBits, uint8_t* target);
+    static void                         packBitRun(const uint8_t* begin, std::size_t numBits, uint8_t* target);
+    static void                         packBitRun(uint8_t* begin, std::size_t numBits, uint8_t* target);
+    static void                         packBitRun(const bool* begin, std::size_t numBits, uint8_t* target);
+    static void                         packBitRun(bool* begin, std::size_t numBits, uint8_t* target);
+    static void                         packBitRun(std::vector<uint8_t>::const_iterator begin, std::size_t numBits, uint8_t* target);
+    static void                         packBitRun(std::vector<uint8_t>::iterator begin, std::size_t numBits, uint8_t* target);
+
     template <typename Iterator>
-    void                                encodeReadRegsRsp(Iterator begin, Iterator end, FunctionCode code, std::vector<uint8_t>& buffer) const;
+    static void                         swapRegisters(Iterator begin, std::size_t numRegs, uint8_t* target);
+    static void                         swapRegisters(const uint16_t* begin, std::size_t numRegs, uint8_t* target);
+    static void                         swapRegisters(uint16_t* begin, std::size_t numRegs, uint8_t* target);
+    static void                         swapRegisters(std::vector<uint16_t>::const_iterator begin, std::size_t numRegs, uint8_t* target);
+    static void                         swapRegisters(std::vector<uint16_t>::iterator begin, std::size_t numRegs, uint8_t* target);
+
+    static void                         checkCapacity(std::size_t size, std::size_t capacity);
 
     void                                fillHeader(modbus::tcp::Header* header, uint16_t size, FunctionCode code) const;
 
@@ -84,130 +176,214 @@ void Encoder::setTransactionId(const TransactionId& transactionId) {
 }
 
 
+constexpr std::size_t Encoder::readReqSize() {
+    return sizeof(ReadReq);
+}
+
+
+constexpr std::size_t Encoder::writeSingleValueSize() {
+    return sizeof(WriteSingleValue);
+}
+
+
+constexpr std::size_t Encoder::writeCoilsReqSize(std::size_t numCoils) {
+    return sizeof(WriteCoilsReq) + (numCoils + 7) / 8;
+}
+
+
+constexpr std::size_t Encoder::writeRegistersReqSize(std::size_t numRegs) {
+    return sizeof(WriteRegistersReq) + 2 * numRegs;
+}
+
+
+constexpr std::size_t Encoder::readBitsRspSize(std::size_t numBits) {
+    return sizeof(ReadCoilsRsp) + (numBits + 7) / 8;
+}
+
+
+constexpr std::size_t Encoder::readRegistersRspSize(std::size_t numRegs) {
+    return sizeof(ReadRegsRsp) + 2 * numRegs;
+}
+
+
+constexpr std::size_t Encoder::writeValuesRspSize() {
+    return sizeof(WriteValuesRsp);
+}
+
+
+constexpr std::size_t Encoder::errorRspSize() {
+    return sizeof(ExceptionRsp);
+}
+
+
 void Encoder::encodeReadCoilsReq(const Address& startAddress, const NumBits& numBits, std::vector<uint8_t>& target) const {
-    encodeReadReq(FunctionCode::READ_COILS, startAddress.get(), numBits.get(), target);
+    target.resize(readReqSize());
+    encodeReadCoilsReq(startAddress, numBits, target.data(), target.size());
 }
 
 
 void Encoder::encodeReadDiscreteInputsReq(const Address& startAddress, const NumBits& numBits, std::vector<uint8_t>& target) const {
-    encodeReadReq(FunctionCode::READ_DISCRETE_INPUTS, startAddress.get(), numBits.get(), target);
+    target.resize(readReqSize());
+    encodeReadDiscreteInputsReq(startAddress, numBits, target.data(), target.size());
 }
 
 
 void Encoder::encodeReadHoldingRegistersReq(const Address& startAddress, const NumRegs& numRegs, std::vector<uint8_t>& target) const {
-    encodeReadReq(FunctionCode::READ_HOLDING_REGISTERS, startAddress.get(), numRegs.get(), target);
+    target.resize(readReqSize());
+    encodeReadHoldingRegistersReq(startAddress, numRegs, target.data(), target.size());
 }
 
 
 void Encoder::encodeReadInputRegistersReq(const Address& startAddress, const NumRegs& numRegs, std::vector<uint8_t>& target) const {
-    encodeReadReq(FunctionCode::READ_INPUT_REGISTERS, startAddress.get(), numRegs.get(), target);
+    target.resize(readReqSize());
+    encodeReadInputRegistersReq(startAddress, numRegs, target.data(), target.size());
 }
 
 
-void Encoder::encodeReadReq(FunctionCode funcCode, uint16_t startAddress, uint16_t numValues, std::vector<uint8_t>& target) const {
-    target.resize(sizeof(ReadReq));
+std::size_t Encoder::encodeReadCoilsReq(const Address& startAddress, const NumBits& numBits, uint8_t* target, std::size_t capacity) const {
+    return encodeReadReq(FunctionCode::READ_COILS, startAddress.get(), numBits.get(), target, capacity);
+}
+
+
+std::size_t Encoder::encodeReadDiscreteInputsReq(const Address& startAddress, const NumBits& numBits, uint8_t* target, std::size_t capacity) const {
+    return encodeReadReq(FunctionCode::READ_DISCRETE_INPUTS, startAddress.get(), numBits.get(), target, capacity);
+}
+
+
+std::size_t Encoder::encodeReadHoldingRegistersReq(const Address& startAddress, const NumRegs& numRegs, uint8_t* target, std::size_t capacity) const {
+    return encodeReadReq(FunctionCode::READ_HOLDING_REGISTERS, startAddress.get(), numRegs.get(), target, capacity);
+}
+
 
-    auto* msg = reinterpret_cast<ReadReq*>(target.data());
+std::size_t Encoder::encodeReadInputRegistersReq(const Address& startAddress, const NumRegs& numRegs, uint8_t* target, std::size_t capacity) const {
+    return encodeReadReq(FunctionCode::READ_INPUT_REGISTERS, startAddress.get(), numRegs.get(), target, capacity);
+}
+
+
+std::size_t Encoder::encodeReadReq(FunctionCode funcCode, uint16_t startAddress, uint16_t numValues, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(readReqSize(), capacity);
+
+    auto* msg = reinterpret_cast<ReadReq*>(target);
     fillHeader(&msg->header, sizeof(ReadReq), funcCode);
 
     msg->startAddress = htons(startAddress);
     msg->numEntries = htons(numValues);
+
+    return sizeof(ReadReq);
 }
 
 
 void Encoder::encodeWriteSingleCoilReq(const Address& address, bool value, std::vector<uint8_t>& target) const {
-    encodeWriteSingleValue(FunctionCode::WRITE_COIL, address.get(), value ? 0xFF00 : 0x0000, target);
+    target.resize(writeSingleValueSize());
+    encodeWriteSingleCoilReq(address, value, target.data(), target.size());
 }
 
 
 void Encoder::encodeWriteSingleRegisterReq(const Address& address, uint16_t value, std::vector<uint8_t>& target) const {
-    encodeWriteSingleValue(FunctionCode::WRITE_REGISTER, address.get(), value, target);
+    target.resize(writeSingleValueSize());
+    encodeWriteSingleRegisterReq(address, value, target.data(), target.size());
+}
+
+
+std::size_t Encoder::encodeWriteSingleCoilReq(const Address& address, bool value, uint8_t* target, std::size_t capacity) const {
+    return encodeWriteSingleValue(FunctionCode::WRITE_COIL, address.get(), value ? 0xFF00 : 0x0000, target, capacity);
+}
+
+
+std::size_t Encoder::encodeWriteSingleRegisterReq(const Address& address, uint16_t value, uint8_t* target, std::size_t capacity) const {
+    return encodeWriteSingleValue(FunctionCode::WRITE_REGISTER, address.get(), value, target, capacity);
 }
 
 
 template <typename Iterator>
 void Encoder::encodeWriteCoilsReq(const Address& startAddress, Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
-    std::size_t num_bits = 0;
-    for (auto it = begin; it != end; ++it)
-        num_bits++;
+    target.resize(sizeHint(begin, end, &writeCoilsReqSize));
+    target.resize(encodeWriteCoilsReq(startAddress, begin, end, target.data(), target.size()));
+}
 
-    std::size_t numBytes = num_bits/8;
-    if (num_bits%8 != 0)
-        numBytes += 1;
 
-    target.resize(sizeof(WriteCoilsReq) + numBytes);
-    std::fill(target.begin(), target.end(), 0);
+template <typename Iterator>
+std::size_t Encoder::encodeWriteCoilsReq(const Address& startAddress, Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(sizeof(WriteCoilsReq), capacity);
+
+    std::size_t num_bits = packBits(begin, end, target + sizeof(WriteCoilsReq), capacity - sizeof(WriteCoilsReq));
+    std::size_t size = writeCoilsReqSize(num_bits);
 
-    auto* msg = reinterpret_cast<WriteCoilsReq*>(target.data());
-    fillHeader(&msg->header, sizeof(WriteCoilsReq) + numBytes, FunctionCode::WRITE_COILS);
+    auto* msg = reinterpret_cast<WriteCoilsReq*>(target);
+    fillHeader(&msg->header, size, FunctionCode::WRITE_COILS);
 
     msg->startAddress = htons(startAddress.get());
     msg->numBits = htons(num_bits);
-    msg->numBytes = numBytes;
-
-    std::size_t pos = 0;
+    msg->numBytes = size - sizeof(WriteCoilsReq);
 
-    for (auto it = begin; it != end; ++it) {
-        std::size_t byte_idx = pos / 8;
-        std::size_t bit_idx = pos % 8;
+    return size;
+}
 
-        if (*it)
-            msg->coils[byte_idx] |= (1 << bit_idx);
 
-        ++pos;
-    }
+template <typename Iterator>
+void Encoder::encodeWriteRegistersReq(const Address& startAddress, Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
+    target.resize(sizeHint(begin, end, &writeRegistersReqSize));
+    target.resize(encodeWriteRegistersReq(startAddress, begin, end, target.data(), target.size()));
 }
 
 
 template <typename Iterator>
-void Encoder::encodeWriteRegistersReq(const Address& startAddress, Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
-    std::size_t numRegs = 0;
-    for (auto it = begin; it != end; ++it)
-        numRegs++;
+std::size_t Encoder::encodeWriteRegistersReq(const Address& startAddress, Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(sizeof(WriteRegistersReq), capacity);
 
-    target.resize(sizeof(WriteRegistersReq) + 2*numRegs);
+    std::size_t numRegs = packRegisters(begin, end, target + sizeof(WriteRegistersReq), capacity - sizeof(WriteRegistersReq));
+    std::size_t size = writeRegistersReqSize(numRegs);
 
-    auto* msg = reinterpret_cast<WriteRegistersReq*>(target.data());
+    auto* msg = reinterpret_cast<WriteRegistersReq*>(target);
+    fillHeader(&msg->header, size, FunctionCode::WRITE_REGISTERS);
 
-    msg->header.transactionId = htons(m_transactionId.get());
-    msg->header.protocolId = htons(MODBUS_PROTOCOL_ID);
-    msg->header.length = htons(sizeof(WriteRegistersReq) + 2*numRegs - 6);
-    msg->header.unitId = m_unitId.get();
-    msg->header.functionCode = static_cast<uint8_t>(FunctionCode::WRITE_REGISTERS);
     msg->startAddress = htons(startAddress.get());
     msg->numRegs = htons(numRegs);
     msg->numBytes = 2*numRegs;
 
-    std::size_t pos = 0;
-    for (auto it = begin; it != end; ++it)
-        msg->regs[pos++] = htons(*it);
+    return size;
 }
 
 
-void Encoder::encodeWriteSingleValue(FunctionCode funcCode, uint16_t address, uint16_t value, std::vector<uint8_t>& target) const {
-    target.resize(sizeof(WriteSingleValue));
+std::size_t Encoder::encodeWriteSingleValue(FunctionCode funcCode, uint16_t address, uint16_t value, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(writeSingleValueSize(), capacity);
 
-    auto* msg = reinterpret_cast<WriteSingleValue*>(target.data());
+    auto* msg = reinterpret_cast<WriteSingleValue*>(target);
     fillHeader(&msg->header, sizeof(WriteSingleValue), funcCode);
 
     msg->address = htons(address);
     msg->value = htons(value);
+
+    return sizeof(WriteSingleValue);
 }
 
 
 void Encoder::encodeWriteSingleCoilRsp(const Address& address, bool value, std::vector<uint8_t>& target) const {
-    encodeWriteSingleValue(FunctionCode::WRITE_COIL, address.get(), value ? 0xFF00 : 0x0000, target);
+    target.resize(writeSingleValueSize());
+    encodeWriteSingleCoilRsp(address, value, target.data(), target.size());
 }
 
 
 void Encoder::encodeWriteSingleRegisterRsp(const Address& address, uint16_t value, std::vector<uint8_t>& target) const {
-    encodeWriteSingleValue(FunctionCode::WRITE_REGISTER, address.get(), value, target);
+    target.resize(writeSingleValueSize());
+    encodeWriteSingleRegisterRsp(address, value, target.data(), target.size());
+}
+
+
+std::size_t Encoder::encodeWriteSingleCoilRsp(const Address& address, bool value, uint8_t* target, std::size_t capacity) const {
+    return encodeWriteSingleValue(FunctionCode::WRITE_COIL, address.get(), value ? 0xFF00 : 0x0000, target, capacity);
+}
+
+
+std::size_t Encoder::encodeWriteSingleRegisterRsp(const Address& address, uint16_t value, uint8_t* target, std::size_t capacity) const {
+    return encodeWriteSingleValue(FunctionCode::WRITE_REGISTER, address.get(), value, target, capacity);
 }
 
 
 template<typename Iterator>
 void Encoder::encodeReadCoilsRsp(Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
-    encodeReadBitsRsp(begin, end, FunctionCode::READ_COILS, target);
+    target.resize(sizeHint(begin, end, &readBitsRspSize));
+    target.resize(encodeReadCoilsRsp(begin, end, target.data(), target.size()));
 }
 
 
@@ -219,101 +395,343 @@ void Encoder::encodeReadCoilsRsp(const Vector& values, std::vector<uint8_t>& tar
 
 template<typename Iterator>
 void Encoder::encodeReadDiscreteInputsRsp(Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
-    encodeReadBitsRsp(begin, end, FunctionCode::READ_DISCRETE_INPUTS, target);
+    target.resize(sizeHint(begin, end, &readBitsRspSize));
+    target.resize(encodeReadDiscreteInputsRsp(begin, end, target.data(), target.size()));
 }
 
 
-template <typename Iterator>
-void Encoder::encodeReadBitsRsp(Iterator begin, Iterator end, FunctionCode code, std::vector<uint8_t>& target) const {
-    std::size_t num_bits = 0;
-    for (auto it = begin; it != end; ++it)
-        num_bits++;
+template<typename Iterator>
+std::size_t Encoder::encodeReadCoilsRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const {
+    return encodeReadBitsRsp(begin, end, FunctionCode::READ_COILS, target, capacity);
+}
 
-    std::size_t numBytes = num_bits/8;
-    if (num_bits%8 != 0)
-        numBytes += 1;
 
-    target.resize(sizeof(ReadCoilsRsp) + numBytes);
-    std::fill(target.begin(), target.end(), 0);
+template<typename Iterator>
+std::size_t Encoder::encodeReadDiscreteInputsRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const {
+    return encodeReadBitsRsp(begin, end, FunctionCode::READ_DISCRETE_INPUTS, target, capacity);
+}
 
-    auto* msg = reinterpret_cast<ReadCoilsRsp*>(target.data());
-    fillHeader(&msg->header, sizeof(ReadCoilsRsp) + numBytes, code);
-    msg->numBytes = numBytes;
 
-    std::size_t pos = 0;
+template <typename Iterator>
+std::size_t Encoder::encodeReadBitsRsp(Iterator begin, Iterator end, FunctionCode code, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(sizeof(ReadCoilsRsp), capacity);
 
-    for (auto it = begin; it != end; ++it) {
-        std::size_t byte_idx = pos / 8;
-        std::size_t bit_idx = pos % 8;
+    std::size_t numBits = packBits(begin, end, target + sizeof(ReadCoilsRsp), capacity - sizeof(ReadCoilsRsp));
+    std::size_t size = readBitsRspSize(numBits);
 
-        if (*it)
-            msg->coils[byte_idx] |= (1 << bit_idx);
+    auto* msg = reinterpret_cast<ReadCoilsRsp*>(target);
+    fillHeader(&msg->header, size, code);
+    msg->numBytes = size - sizeof(ReadCoilsRsp);
 
-        ++pos;
-    }
+    return size;
 }
 
 
 template<typename Iterator>
 void Encoder::encodeReadHoldingRegistersRsp(Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
-    encodeReadRegsRsp(begin, end, FunctionCode::READ_HOLDING_REGISTERS, target);
+    target.resize(sizeHint(begin, end, &readRegistersRspSize));
+    target.resize(encodeReadHoldingRegistersRsp(begin, end, target.data(), target.size()));
 }
 
 
 template<typename Iterator>
 void Encoder::encodeReadInputRegistersRsp(Iterator begin, Iterator end, std::vector<uint8_t>& target) const {
-    encodeReadRegsRsp(begin, end, FunctionCode::READ_INPUT_REGISTERS, target);
+    target.resize(sizeHint(begin, end, &readRegistersRspSize));
+    target.resize(encodeReadInputRegistersRsp(begin, end, target.data(), target.size()));
 }
 
 
-template <typename Iterator>
-void Encoder::encodeReadRegsRsp(Iterator begin, Iterator end, FunctionCode code, std::vector<uint8_t>& target) const {
-    std::size_t numBytes = 0;
-    for (auto it = begin; it != end; ++it)
-        numBytes += 2;
+template<typename Iterator>
+std::size_t Encoder::encodeReadHoldingRegistersRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const {
+    return encodeReadRegsRsp(begin, end, FunctionCode::READ_HOLDING_REGISTERS, target, capacity);
+}
 
-    target.resize(sizeof(ReadRegsRsp) + numBytes);
 
-    auto* msg = reinterpret_cast<ReadRegsRsp*>(target.data());
+template<typename Iterator>
+std::size_t Encoder::encodeReadInputRegistersRsp(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) const {
+    return encodeReadRegsRsp(begin, end, FunctionCode::READ_INPUT_REGISTERS, target, capacity);
+}
 
-    fillHeader(&msg->header, sizeof(ReadRegsRsp) + numBytes, code);
-    msg->numBytes = numBytes;
 
-    std::size_t pos = 0;
-    for (auto it = begin; it != end; ++it)
-        msg->regs[pos++] = htons(*it);
+template <typename Iterator>
+std::size_t Encoder::encodeReadRegsRsp(Iterator begin, Iterator end, FunctionCode code, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(sizeof(ReadRegsRsp), capacity);
+
+    std::size_t numRegs = packRegisters(begin, end, target + sizeof(ReadRegsRsp), capacity - sizeof(ReadRegsRsp));
+    std::size_t size = readRegistersRspSize(numRegs);
+
+    auto* msg = reinterpret_cast<ReadRegsRsp*>(target);
+    fillHeader(&msg->header, size, code);
+    msg->numBytes = 2*numRegs;
+
+    return size;
 }
 
 
 void Encoder::encodeWriteCoilsRsp(const Address& startAddress, const NumBits& numCoils, std::vector<uint8_t>& target) const {
-    target.resize(sizeof(WriteValuesRsp));
-    auto* msg = reinterpret_cast<WriteValuesRsp*>(target.data());
-
-    fillHeader(&msg->header, sizeof(WriteValuesRsp), FunctionCode::WRITE_COILS);
-    msg->startAddress = htons(startAddress.get());
-    msg->numValues = htons(numCoils.get());
+    target.resize(writeValuesRspSize());
+    encodeWriteCoilsRsp(startAddress, numCoils, target.data(), target.size());
 }
 
 
 void Encoder::encodeWriteRegistersRsp(const Address& startAddress, const NumRegs& numRegs, std::vector<uint8_t>& target) const {
-    target.resize(sizeof(WriteValuesRsp));
+    target.resize(writeValuesRspSize());
+    encodeWriteRegistersRsp(startAddress, numRegs, target.data(), target.size());
+}
 
-    auto* msg = reinterpret_cast<WriteValuesRsp*>(target.data());
-    fillHeader(&msg->header, sizeof(WriteValuesRsp), FunctionCode::WRITE_REGISTERS);
 
-    msg->startAddress = htons(startAddress.get());
-    msg->numValues = htons(numRegs.get());
+std::size_t Encoder::encodeWriteCoilsRsp(const Address& startAddress, const NumBits& numCoils, uint8_t* target, std::size_t capacity) const {
+    return encodeWriteValuesRsp(FunctionCode::WRITE_COILS, startAddress.get(), numCoils.get(), target, capacity);
+}
+
+
+std::size_t Encoder::encodeWriteRegistersRsp(const Address& startAddress, const NumRegs& numRegs, uint8_t* target, std::size_t capacity) const {
+    return encodeWriteValuesRsp(FunctionCode::WRITE_REGISTERS, startAddress.get(), numRegs.get(), target, capacity);
+}
+
+
+std::size_t Encoder::encodeWriteValuesRsp(FunctionCode code, uint16_t startAddress, uint16_t numValues, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(writeValuesRspSize(), capacity);
+
+    auto* msg = reinterpret_cast<WriteValuesRsp*>(target);
+    fillHeader(&msg->header, sizeof(WriteValuesRsp), code);
+
+    msg->startAddress = htons(startAddress);
+    msg->numValues = htons(numValues);
+
+    return sizeof(WriteValuesRsp);
 }
 
 
 void Encoder::encodeErrorRsp(FunctionCode code, ExceptionCode ex, std::vector<uint8_t>& target) const {
-    target.resize(sizeof(ExceptionRsp));
+    target.resize(errorRspSize());
+    encodeErrorRsp(code, ex, target.data(), target.size());
+}
+
+
+std::size_t Encoder::encodeErrorRsp(FunctionCode code, ExceptionCode ex, uint8_t* target, std::size_t capacity) const {
+    checkCapacity(errorRspSize(), capacity);
 
-    auto* msg = reinterpret_cast<ExceptionRsp*>(target.data());
+    auto* msg = reinterpret_cast<ExceptionRsp*>(target);
     fillHeader(&msg->header, sizeof(ExceptionRsp), code);
 
     msg->header.functionCode = static_cast<uint8_t>(code) | 0x80;
     msg->code = static_cast<uint8_t>(ex);
+
+    return sizeof(ExceptionRsp);
+}
+
+
+std::size_t Encoder::encodeReadBitsRspHeader(FunctionCode code, std::size_t numBits, uint8_t* target, std::size_t capacity) const {
+    std::size_t size = readBitsRspSize(numBits);
+
+    checkCapacity(size, capacity);
+
+    auto* msg = reinterpret_cast<ReadCoilsRsp*>(target);
+    fillHeader(&msg->header, size, code);
+    msg->numBytes = size - sizeof(ReadCoilsRsp);
+
+    return size;
+}
+
+
+std::size_t Encoder::encodeReadRegistersRspHeader(FunctionCode code, std::size_t numRegs, uint8_t* target, std::size_t capacity) const {
+    std::size_t size = readRegistersRspSize(numRegs);
+
+    checkCapacity(size, capacity);
+
+    auto* msg = reinterpret_cast<ReadRegsRsp*>(target);
+    fillHeader(&msg->header, size, code);
+    msg->numBytes = 2*numRegs;
+
+    return size;
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::sizeHint(Iterator begin, Iterator end, SizeFunction size) {
+    return sizeHint(begin, end, size, typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::sizeHint(Iterator begin, Iterator end, SizeFunction size, std::random_access_iterator_tag) {
+    return size(std::distance(begin, end));
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::sizeHint(Iterator, Iterator, SizeFunction, std::input_iterator_tag) {
+    return MODBUS_MAX_ADU_LENGTH;
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::packBits(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) {
+    return packBits(begin, end, target, capacity, typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::packBits(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::random_access_iterator_tag) {
+    std::size_t numBits = std::distance(begin, end);
+
+    checkCapacity((numBits + 7) / 8, capacity);
+
+    if (numBits != 0)
+        packBitRun(begin, numBits, target);
+
+    return numBits;
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::packBits(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::input_iterator_tag) {
+    std::size_t pos = 0;
+    uint8_t byte = 0;
+
+    for (auto it = begin; it != end; ++it) {
+        if (*it)
+            byte |= (1 << (pos % 8));
+
+        if (++pos % 8 == 0) {
+            checkCapacity(pos / 8, capacity);
+            target[pos / 8 - 1] = byte;
+            byte = 0;
+        }
+    }
+
+    if (pos % 8 != 0) {
+        checkCapacity(pos / 8 + 1, capacity);
+        target[pos / 8] = byte;
+    }
+
+    return pos;
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::packRegisters(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity) {
+    return packRegisters(begin, end, target, capacity, typename std::iterator_traits<Iterator>::iterator_category());
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::packRegisters(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::random_access_iterator_tag) {
+    std::size_t numRegs = std::distance(begin, end);
+
+    checkCapacity(2*numRegs, capacity);
+
+    if (numRegs != 0)
+        swapRegisters(begin, numRegs, target);
+
+    return numRegs;
+}
+
+
+template <typename Iterator>
+std::size_t Encoder::packRegisters(Iterator begin, Iterator end, uint8_t* target, std::size_t capacity, std::input_iterator_tag) {
+    std::size_t numRegs = 0;
+
+    for (auto it = begin; it != end; ++it, ++numRegs) {
+        checkCapacity(2*numRegs + 2, capacity);
+
+        uint16_t value = *it;
+        target[2*numRegs] = value >> 8;
+        target[2*numRegs + 1] = value & 0xff;
+    }
+
+    return numRegs;
+}
+
+
+template <typename Iterator>
+void Encoder::packBitRun(Iterator begin, std::size_t numBits, uint8_t* target) {
+    std::size_t numFullBytes = numBits / 8;
+    std::size_t numRemaining = numBits % 8;
+
+    for (std::size_t i = 0; i < numFullBytes; ++i, begin += 8) {
+        target[i] = static_cast<uint8_t>(
+            (begin[0] ? 0x01 : 0) | (begin[1] ? 0x02 : 0) | (begin[2] ? 0x04 : 0) | (begin[3] ? 0x08 : 0) |
+            (begin[4] ? 0x10 : 0) | (begin[5] ? 0x20 : 0) | (begin[6] ? 0x40 : 0) | (begin[7] ? 0x80 : 0));
+    }
+
+    if (numRemaining != 0) {
+        uint8_t byte = 0;
+
+        for (std::size_t bit = 0; bit < numRemaining; ++bit)
+            if (begin[bit])
+                byte |= (1 << bit);
+
+        target[numFullBytes] = byte;
+    }
+}
+
+
+void Encoder::packBitRun(const uint8_t* begin, std::size_t numBits, uint8_t* target) {
+    modbus::tcp::packBits(begin, numBits, target);
+}
+
+
+void Encoder::packBitRun(uint8_t* begin, std::size_t numBits, uint8_t* target) {
+    modbus::tcp::packBits(static_cast<const uint8_t*>(begin), numBits, target);
+}
+
+
+void Encoder::packBitRun(const bool* begin, std::size_t numBits, uint8_t* target) {
+    static_assert(sizeof(bool) == 1, "bool arrays are packed as byte arrays");
+    modbus::tcp::packBits(reinterpret_cast<const uint8_t*>(begin), numBits, target);
+}
+
+
+void Encoder::packBitRun(bool* begin, std::size_t numBits, uint8_t* target) {
+    packBitRun(static_cast<const bool*>(begin), numBits, target);
+}
+
+
+void Encoder::packBitRun(std::vector<uint8_t>::const_iterator begin, std::size_t numBits, uint8_t* target) {
+    packBitRun(&*begin, numBits, target);
+}
+
+
+void Encoder::packBitRun(std::vector<uint8_t>::iterator begin, std::size_t numBits, uint8_t* target) {
+    packBitRun(&*begin, numBits, target);
+}
+
+
+template <typename Iterator>
+void Encoder::swapRegisters(Iterator begin, std::size_t numRegs, uint8_t* target) {
+    for (std::size_t i = 0; i < numRegs; ++i) {
+        uint16_t value = begin[i];
+        target[2*i] = value >> 8;
+        target[2*i + 1] = value & 0xff;
+    }
+}
+
+
+void Encoder::swapRegisters(const uint16_t* begin, std::size_t numRegs, uint8_t* target) {
+    encodeRegisters(begin, numRegs, target);
+}
+
+
+void Encoder::swapRegisters(uint16_t* begin, std::size_t numRegs, uint8_t* target) {
+    swapRegisters(static_cast<const uint16_t*>(begin), numRegs, target);
+}
+
+
+void Encoder::swapRegisters(std::vector<uint16_t>::const_iterator begin, std::size_t numRegs, uint8_t* target) {
+    swapRegisters(&*begin, numRegs, target);
+}
+
+
+void Encoder::swapRegisters(std::vector<uint16_t>::iterator begin, std::size_t numRegs, uint8_t* target) {
+    swapRegisters(&*begin, numRegs, target);
+}
+
+
+void Encoder::checkCapacity(std::size_t size, std::size_t capacity) {
+    if (size > capacity)
+        throw BufferTooSmall("encoded message does not fit into target buffer");
 }
 
 
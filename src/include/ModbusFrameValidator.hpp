@@ -0,0 +1,219 @@
+#ifndef MODBUS_FRAME_VALIDATOR_HPP
+#define MODBUS_FRAME_VALIDATOR_HPP
+
+#include "ModbusConsts.hpp"
+#include "ModbusTypes.hpp"
+#include <cstddef>
+#include <vector>
+
+
+namespace modbus {
+namespace tcp {
+
+enum class FrameError : uint8_t {
+    OK = 0,
+
+    // framing errors, the byte stream can no longer be trusted
+    TOO_SHORT,
+    BAD_PROTOCOL_ID,
+    BAD_LENGTH,
+
+    // well framed, but the PDU is not acceptable
+    ILLEGAL_FUNCTION,
+    BAD_SIZE,
+    BAD_QUANTITY,
+    BAD_BYTE_COUNT,
+    BAD_VALUE
+};
+
+
+// All validators are single pass, never throw and never read beyond size bytes. Once a frame has
+// been accepted, the matching decoder_views may be used on it without further checks.
+inline FrameError                       validateHeader(const uint8_t* frame, std::size_t size);
+inline FrameError                       validateRequest(const uint8_t* frame, std::size_t size);
+inline FrameError                       validateResponse(const uint8_t* frame, std::size_t size);
+
+inline FrameError                       validateRequest(const std::vector<uint8_t>& frame);
+inline FrameError                       validateResponse(const std::vector<uint8_t>& frame);
+
+inline bool                             isFramingError(FrameError error);
+inline ExceptionCode                    toExceptionCode(FrameError error);
+
+
+namespace frame_validator {
+
+inline uint16_t readWord(const uint8_t* ptr) {
+    return (ptr[0] << 8) | ptr[1];
+}
+
+
+inline FrameError checkQuantity(uint16_t quantity, uint16_t max) {
+    return (quantity == 0 || quantity > max) ? FrameError::BAD_QUANTITY : FrameError::OK;
+}
+
+
+inline FrameError checkReadReq(std::size_t size, uint16_t max, const uint8_t* frame) {
+    if (size != sizeof(ReadReq))
+        return FrameError::BAD_SIZE;
+
+    return checkQuantity(readWord(frame + offsetof(ReadReq, numEntries)), max);
+}
+
+
+inline FrameError checkWriteMultipleReq(std::size_t size, uint16_t max, std::size_t bytesPerValue, const uint8_t* frame) {
+    // WriteCoilsReq and WriteRegistersReq share their layout up to the payload
+    if (size < sizeof(WriteCoilsReq))
+        return FrameError::BAD_SIZE;
+
+    uint16_t quantity = readWord(frame + offsetof(WriteCoilsReq, numBits));
+    std::size_t numBytes = frame[offsetof(WriteCoilsReq, numBytes)];
+
+    if (checkQuantity(quantity, max) != FrameError::OK)
+        return FrameError::BAD_QUANTITY;
+
+    std::size_t expectedBytes = bytesPerValue == 0 ? (quantity + 7) / 8 : bytesPerValue * quantity;
+
+    if (numBytes != expectedBytes)
+        return FrameError::BAD_BYTE_COUNT;
+
+    if (size != sizeof(WriteCoilsReq) + numBytes)
+        return FrameError::BAD_SIZE;
+
+    return FrameError::OK;
+}
+
+} // namespace frame_validator
+
+
+FrameError validateHeader(const uint8_t* frame, std::size_t size) {
+    if (size < sizeof(Header))
+        return FrameError::TOO_SHORT;
+
+    if (frame_validator::readWord(frame + offsetof(Header, protocolId)) != MODBUS_PROTOCOL_ID)
+        return FrameError::BAD_PROTOCOL_ID;
+
+    std::size_t length = frame_validator::readWord(frame + offsetof(Header, length));
+
+    // unit id and function code are the minimum, a full ADU the maximum
+    if (length < 2 || length + 6 > MODBUS_MAX_ADU_LENGTH)
+        return FrameError::BAD_LENGTH;
+
+    return FrameError::OK;
+}
+
+
+FrameError validateRequest(const uint8_t* frame, std::size_t size) {
+    using namespace frame_validator;
+
+    FrameError error = validateHeader(frame, size);
+
+    if (error != FrameError::OK)
+        return error;
+
+    if (readWord(frame + offsetof(Header, length)) + std::size_t(6) != size)
+        return FrameError::BAD_LENGTH;
+
+    switch (frame[offsetof(Header, functionCode)]) {
+        case static_cast<uint8_t>(FunctionCode::READ_COILS):
+        case static_cast<uint8_t>(FunctionCode::READ_DISCRETE_INPUTS):
+            return checkReadReq(size, MODBUS_MAX_NUM_BITS_IN_READ_REQUEST, frame);
+
+        case static_cast<uint8_t>(FunctionCode::READ_HOLDING_REGISTERS):
+        case static_cast<uint8_t>(FunctionCode::READ_INPUT_REGISTERS):
+            return checkReadReq(size, MODBUS_MAX_NUM_REGS_IN_READ_REQUEST, frame);
+
+        case static_cast<uint8_t>(FunctionCode::WRITE_COIL): {
+            if (size != sizeof(WriteSingleValue))
+                return FrameError::BAD_SIZE;
+
+            uint16_t value = readWord(frame + offsetof(WriteSingleValue, value));
+            return (value == 0x0000 || value == 0xFF00) ? FrameError::OK : FrameError::BAD_VALUE;
+        }
+
+        case static_cast<uint8_t>(FunctionCode::WRITE_REGISTER):
+            return size == sizeof(WriteSingleValue) ? FrameError::OK : FrameError::BAD_SIZE;
+
+        case static_cast<uint8_t>(FunctionCode::WRITE_COILS):
+            return checkWriteMultipleReq(size, MODBUS_MAX_NUM_BITS_IN_WRITE_REQUEST, 0, frame);
+
+        case static_cast<uint8_t>(FunctionCode::WRITE_REGISTERS):
+            return checkWriteMultipleReq(size, MODBUS_MAX_NUM_REGS_IN_WRITE_REQUEST, 2, frame);
+
+        default:
+            return FrameError::ILLEGAL_FUNCTION;
+    }
+}
+
+
+FrameError validateResponse(const uint8_t* frame, std::size_t size) {
+    using namespace frame_validator;
+
+    FrameError error = validateHeader(frame, size);
+
+    if (error != FrameError::OK)
+        return error;
+
+    if (readWord(frame + offsetof(Header, length)) + std::size_t(6) != size)
+        return FrameError::BAD_LENGTH;
+
+    const uint8_t functionCode = frame[offsetof(Header, functionCode)];
+
+    if (functionCode & 0x80)
+        return size == sizeof(ExceptionRsp) ? FrameError::OK : FrameError::BAD_SIZE;
+
+    switch (functionCode) {
+        case static_cast<uint8_t>(FunctionCode::READ_COILS):
+        case static_cast<uint8_t>(FunctionCode::READ_DISCRETE_INPUTS):
+        case static_cast<uint8_t>(FunctionCode::READ_HOLDING_REGISTERS):
+        case static_cast<uint8_t>(FunctionCode::READ_INPUT_REGISTERS): {
+            // ReadCoilsRsp and ReadRegsRsp share their layout up to the payload
+            if (size < sizeof(ReadCoilsRsp))
+                return FrameError::BAD_SIZE;
+
+            std::size_t numBytes = frame[offsetof(ReadCoilsRsp, numBytes)];
+            bool registers = functionCode == static_cast<uint8_t>(FunctionCode::READ_HOLDING_REGISTERS) ||
+                             functionCode == static_cast<uint8_t>(FunctionCode::READ_INPUT_REGISTERS);
+
+            if (numBytes == 0 || (registers && numBytes % 2 != 0))
+                return FrameError::BAD_BYTE_COUNT;
+
+            return size == sizeof(ReadCoilsRsp) + numBytes ? FrameError::OK : FrameError::BAD_BYTE_COUNT;
+        }
+
+        case static_cast<uint8_t>(FunctionCode::WRITE_COIL):
+        case static_cast<uint8_t>(FunctionCode::WRITE_REGISTER):
+            return size == sizeof(WriteSingleValue) ? FrameError::OK : FrameError::BAD_SIZE;
+
+        case static_cast<uint8_t>(FunctionCode::WRITE_COILS):
+        case static_cast<uint8_t>(FunctionCode::WRITE_REGISTERS):
+            return size == sizeof(WriteValuesRsp) ? FrameError::OK : FrameError::BAD_SIZE;
+
+        default:
+            return FrameError::ILLEGAL_FUNCTION;
+    }
+}
+
+
+FrameError validateRequest(const std::vector<uint8_t>& frame) {
+    return validateRequest(frame.data(), frame.size());
+}
+
+
+FrameError validateResponse(const std::vector<uint8_t>& frame) {
+    return validateResponse(frame.data(), frame.size());
+}
+
+
+bool isFramingError(FrameError error) {
+    return error == FrameError::TOO_SHORT || error == FrameError::BAD_PROTOCOL_ID || error == FrameError::BAD_LENGTH;
+}
+
+
+ExceptionCode toExceptionCode(FrameError error) {
+    return error == FrameError::ILLEGAL_FUNCTION ? ExceptionCode::ILLEGAL_FUNCTION : ExceptionCode::ILLEGAL_DATA_VALUE;
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef MODBUS_HANDLER_ALLOCATOR_HPP
+#define MODBUS_HANDLER_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace modbus {
+namespace tcp {
+
+// Memory for the completion handler of one asynchronous operation at a time. Asio allocates the
+// operation state through the handler's allocation hooks, so a long lived connection that always
+// has at most one read and one write in flight needs no heap allocation for its handlers. Requests
+// that don't fit, or arrive while the block is in use, fall back to the heap.
+class HandlerMemory {
+public:
+    inline                                  HandlerMemory() : m_inUse(false) {}
+
+                                            HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory&                          operator=(const HandlerMemory&) = delete;
+
+    inline void*                            allocate(std::size_t size);
+    inline void                             deallocate(void* pointer);
+
+private:
+    typename std::aligned_storage<512>::type m_storage;
+    bool                                    m_inUse;
+};
+
+
+// Wraps a completion handler so asio takes its memory from a HandlerMemory.
+template <typename Handler>
+class AllocHandler {
+public:
+    inline                                  AllocHandler(HandlerMemory& memory, Handler handler) :
+                                                m_memory(memory), m_handler(std::move(handler)) {}
+
+    template <typename... Args>
+    void                                    operator()(Args&&... args) { m_handler(std::forward<Args>(args)...); }
+
+    friend void* asio_handler_allocate(std::size_t size, AllocHandler* self) {
+        return self->m_memory.allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void* pointer, std::size_t /*size*/, AllocHandler* self) {
+        self->m_memory.deallocate(pointer);
+    }
+
+private:
+    HandlerMemory                          &m_memory;
+    Handler                                 m_handler;
+};
+
+
+template <typename Handler>
+inline AllocHandler<Handler> makeAllocHandler(HandlerMemory& memory, Handler handler) {
+    return AllocHandler<Handler>(memory, std::move(handler));
+}
+
+
+void* HandlerMemory::allocate(std::size_t size) {
+    if (!m_inUse && size <= sizeof(m_storage)) {
+        m_inUse = true;
+        return &m_storage;
+    }
+
+    return ::operator new(size);
+}
+
+
+void HandlerMemory::deallocate(void* pointer) {
+    if (pointer == &m_storage)
+        m_inUse = false;
+    else
+        ::operator delete(pointer);
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
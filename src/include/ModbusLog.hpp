@@ -0,0 +1,353 @@
+#ifndef MODBUS_LOG_HPP
+#define MODBUS_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+
+
+// Levels below MODBUS_LOG_LEVEL are removed at compile time, their message expressions are never
+// evaluated. Define MODBUS_LOG_LEVEL before including any library header to change it.
+#define MODBUS_LOG_LEVEL_DEBUG      0
+#define MODBUS_LOG_LEVEL_INFO       1
+#define MODBUS_LOG_LEVEL_WARNING    2
+#define MODBUS_LOG_LEVEL_ERROR      3
+#define MODBUS_LOG_LEVEL_OFF        4
+
+#ifndef MODBUS_LOG_LEVEL
+#define MODBUS_LOG_LEVEL            MODBUS_LOG_LEVEL_INFO
+#endif
+
+// Formats message into a fixed size record and queues it for the logger thread; does nothing
+// unless the logger was started. Usage: MODBUS_LOG_INFO("connected to " << endpoint);
+#define MODBUS_LOG(level, message)                                                  \
+    do {                                                                            \
+        if (MODBUS_LOG_LEVEL_##level >= MODBUS_LOG_LEVEL &&                         \
+            ::modbus::Logger::instance().isRunning()) {                             \
+            ::modbus::LogLine modbus_log_line(::modbus::LogLevel::level);           \
+            modbus_log_line.stream() << message;                                    \
+        }                                                                           \
+    } while (false)
+
+#define MODBUS_LOG_DEBUG(message)   MODBUS_LOG(DEBUG, message)
+#define MODBUS_LOG_INFO(message)    MODBUS_LOG(INFO, message)
+#define MODBUS_LOG_WARNING(message) MODBUS_LOG(WARNING, message)
+#define MODBUS_LOG_ERROR(message)   MODBUS_LOG(ERROR, message)
+
+
+namespace modbus {
+
+enum class LogLevel : uint8_t {
+    DEBUG   = MODBUS_LOG_LEVEL_DEBUG,
+    INFO    = MODBUS_LOG_LEVEL_INFO,
+    WARNING = MODBUS_LOG_LEVEL_WARNING,
+    ERROR   = MODBUS_LOG_LEVEL_ERROR
+};
+
+
+inline const char* toString(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG:   return "DEBUG";
+        case LogLevel::INFO:    return "INFO";
+        case LogLevel::WARNING: return "WARNING";
+        case LogLevel::ERROR:   return "ERROR";
+    }
+
+    return "";
+}
+
+
+struct LogRecord {
+    // longer messages are truncated
+    static const std::size_t                MAX_LENGTH = 240;
+
+    std::chrono::system_clock::time_point   time;
+    LogLevel                                level;
+    uint16_t                                length;
+    char                                    text[MAX_LENGTH];
+};
+
+
+// Receives the records on the logger thread, never on the thread that logged them.
+class LogSink {
+public:
+    virtual                                 ~LogSink() {}
+
+    virtual void                            write(const LogRecord& record) = 0;
+
+    // called whenever the queue ran empty
+    virtual void                            flush() {}
+};
+
+
+class StreamLogSink : public LogSink {
+public:
+    inline explicit                         StreamLogSink(std::ostream& os) : m_os(os) {}
+
+    inline void                             write(const LogRecord& record) override;
+    inline void                             flush() override;
+
+private:
+    std::ostream                           &m_os;
+};
+
+
+// Process wide logger. Records are passed to the sink through a bounded lock free queue drained
+// by a background thread, so logging from an io_service thread never waits for I/O or a lock.
+// When the queue is full the record is dropped and counted instead.
+class Logger {
+public:
+    static const std::size_t                QUEUE_SIZE = 1024;     // power of two
+
+    static inline Logger&                   instance();
+
+                                            Logger(const Logger&) = delete;
+    Logger&                                 operator=(const Logger&) = delete;
+
+    // Starts the logger thread, records already queued are written first.
+    inline void                             start(std::shared_ptr<LogSink> sink);
+
+    // Writes what is left in the queue and joins the logger thread.
+    inline void                             stop();
+
+    inline bool                             isRunning() const;
+
+    // Never blocks, returns false when the record was dropped.
+    inline bool                             push(LogLevel level, const char* text, std::size_t length);
+
+    inline std::size_t                      getNumDropped() const;
+
+private:
+    struct Slot {
+        std::atomic<std::size_t>            sequence;
+        LogRecord                           record;
+    };
+
+    std::unique_ptr<Slot[]>                 m_slots;
+    std::atomic<std::size_t>                m_enqueuePos;
+    std::size_t                             m_dequeuePos;   // only used by the logger thread
+    std::atomic<bool>                       m_running;
+    std::atomic<std::size_t>                m_numDropped;
+    std::mutex                              m_control;      // serializes start and stop
+    std::shared_ptr<LogSink>                m_sink;
+    std::thread                             m_thread;
+
+    inline                                  Logger();
+    inline                                 ~Logger();
+
+    inline bool                             pop(LogRecord& record);
+    inline bool                             drain();
+    inline void                             run();
+};
+
+
+// Formats one message into a record without allocating and queues it when destroyed.
+class LogLine {
+public:
+    inline explicit                         LogLine(LogLevel level);
+    inline                                 ~LogLine();
+
+                                            LogLine(const LogLine&) = delete;
+    LogLine&                                operator=(const LogLine&) = delete;
+
+    inline std::ostream&                    stream();
+
+private:
+    // Writes into a fixed array, output beyond its end is discarded.
+    class Buffer : public std::streambuf {
+    public:
+        Buffer(char* begin, char* end) { setp(begin, end); }
+
+        std::size_t                         size() const { return pptr() - pbase(); }
+    };
+
+    LogLevel                                m_level;
+    char                                    m_text[LogRecord::MAX_LENGTH];
+    Buffer                                  m_buffer;
+    std::ostream                            m_stream;
+};
+
+
+void StreamLogSink::write(const LogRecord& record) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(record.time.time_since_epoch()).count();
+    const char fill = m_os.fill('0');
+
+    m_os << us / 1000000 << '.';
+    m_os.width(6);
+    m_os << us % 1000000;
+    m_os.fill(fill);
+
+    m_os << ' ' << toString(record.level) << ' ';
+    m_os.write(record.text, record.length);
+    m_os << '\n';
+}
+
+
+void StreamLogSink::flush() {
+    m_os.flush();
+}
+
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+
+Logger::Logger() :
+    m_slots(new Slot[QUEUE_SIZE]),
+    m_enqueuePos(0),
+    m_dequeuePos(0),
+    m_running(false),
+    m_numDropped(0),
+    m_control(),
+    m_sink(),
+    m_thread()
+{
+    for (std::size_t i = 0; i < QUEUE_SIZE; ++i)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+
+Logger::~Logger() {
+    stop();
+}
+
+
+void Logger::start(std::shared_ptr<LogSink> sink) {
+    std::lock_guard<std::mutex> lock(m_control);
+
+    if (m_running)
+        throw std::logic_error("logger already running");
+
+    m_sink = sink;
+    m_running = true;
+    m_thread = std::thread([this]() { run(); });
+}
+
+
+void Logger::stop() {
+    std::lock_guard<std::mutex> lock(m_control);
+
+    if (!m_running)
+        return;
+
+    m_running = false;
+    m_thread.join();
+    m_sink.reset();
+}
+
+
+bool Logger::isRunning() const {
+    return m_running.load(std::memory_order_relaxed);
+}
+
+
+bool Logger::push(LogLevel level, const char* text, std::size_t length) {
+    // bounded multi producer queue: a producer claims a position by advancing m_enqueuePos, the
+    // sequence of a slot tells whether it is free for that position or still being consumed
+    std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    for (;;) {
+        slot = &m_slots[pos & (QUEUE_SIZE - 1)];
+
+        const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            m_numDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    if (length > LogRecord::MAX_LENGTH)
+        length = LogRecord::MAX_LENGTH;
+
+    slot->record.time = std::chrono::system_clock::now();
+    slot->record.level = level;
+    slot->record.length = static_cast<uint16_t>(length);
+    std::memcpy(slot->record.text, text, length);
+
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+std::size_t Logger::getNumDropped() const {
+    return m_numDropped.load(std::memory_order_relaxed);
+}
+
+
+bool Logger::pop(LogRecord& record) {
+    Slot& slot = m_slots[m_dequeuePos & (QUEUE_SIZE - 1)];
+
+    if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+        return false;
+
+    record = slot.record;
+    slot.sequence.store(m_dequeuePos + QUEUE_SIZE, std::memory_order_release);
+    ++m_dequeuePos;
+    return true;
+}
+
+
+bool Logger::drain() {
+    LogRecord record;
+    bool written = false;
+
+    while (pop(record)) {
+        m_sink->write(record);
+        written = true;
+    }
+
+    if (written)
+        m_sink->flush();
+
+    return written;
+}
+
+
+void Logger::run() {
+    // producers never signal, the queue is polled while it is empty
+    while (m_running) {
+        if (!drain())
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    drain();
+}
+
+
+LogLine::LogLine(LogLevel level) :
+    m_level(level),
+    m_buffer(m_text, m_text + sizeof(m_text)),
+    m_stream(&m_buffer)
+{}
+
+
+LogLine::~LogLine() {
+    Logger::instance().push(m_level, m_text, m_buffer.size());
+}
+
+
+std::ostream& LogLine::stream() {
+    return m_stream;
+}
+
+} // namespace modbus
+
+#endif
@@ -0,0 +1,635 @@
+#ifndef MODBUS_MEMORY_SERVER_DEVICE_HPP
+#define MODBUS_MEMORY_SERVER_DEVICE_HPP
+
+#include "ModbusServerDevice.hpp"
+#include "ModbusBitPacking.hpp"
+#include "ModbusByteOrder.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <vector>
+
+namespace modbus {
+namespace tcp {
+
+// Locking policies for BasicMemoryServerDevice. Each table gets its own Lock; read() and write()
+// run the given function with the table locked for reading or writing. The tables are stored in
+// the policy's Array, which is accessed one element or one byte range at a time.
+
+// For devices accessed from a single thread only, costs nothing.
+struct NoLocking {
+    class Lock {
+    public:
+        template <typename Fn> void     read(Fn fn) const { fn(); }
+        template <typename Fn> void     write(Fn fn) { fn(); }
+    };
+
+    template <typename T>
+    class Array {
+    public:
+        explicit                        Array(std::size_t size) : m_values(size, 0) {}
+
+        std::size_t                     size() const { return m_values.size(); }
+
+        T                               load(std::size_t pos) const { return m_values[pos]; }
+        void                            store(std::size_t pos, T value) { m_values[pos] = value; }
+
+        void                            load(std::size_t pos, std::size_t count, uint8_t* dst) const {
+                                            std::memcpy(dst, m_values.data() + pos, count * sizeof(T));
+                                        }
+
+        void                            store(std::size_t pos, const uint8_t* src, std::size_t count) {
+                                            std::memcpy(m_values.data() + pos, src, count * sizeof(T));
+                                        }
+
+    private:
+        std::vector<T>                  m_values;
+    };
+};
+
+
+// Sequence lock for devices shared between server threads. Readers never block each other or the
+// writers: they copy the data and retry if a write ran in the meantime, so a multi value write is
+// always seen in full or not at all. Writers are serialized by a mutex. Readers may overlap with a
+// writer, so the elements are atomics accessed with relaxed loads and stores, as in ModbusRegisterImage.
+struct SeqLocking {
+    class Lock {
+    public:
+                                        Lock() : m_sequence(0), m_mutex() {}
+
+        template <typename Fn> void     read(Fn fn) const;
+        template <typename Fn> void     write(Fn fn);
+
+    private:
+        std::atomic<uint32_t>           m_sequence;     // odd while a write is in progress
+        std::mutex                      m_mutex;
+    };
+
+    template <typename T>
+    class Array {
+    public:
+        inline explicit                 Array(std::size_t size);
+
+        std::size_t                     size() const { return m_size; }
+
+        T                               load(std::size_t pos) const { return m_values[pos].load(std::memory_order_relaxed); }
+        void                            store(std::size_t pos, T value) { m_values[pos].store(value, std::memory_order_relaxed); }
+
+        inline void                     load(std::size_t pos, std::size_t count, uint8_t* dst) const;
+        inline void                     store(std::size_t pos, const uint8_t* src, std::size_t count);
+
+    private:
+        std::size_t                     m_size;
+        std::unique_ptr<std::atomic<T>[]> m_values;
+    };
+};
+
+
+template <typename Fn>
+void SeqLocking::Lock::read(Fn fn) const {
+    for (;;) {
+        const uint32_t before = m_sequence.load(std::memory_order_acquire);
+
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        fn();
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (m_sequence.load(std::memory_order_relaxed) == before)
+            return;
+    }
+}
+
+
+template <typename Fn>
+void SeqLocking::Lock::write(Fn fn) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    fn();
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+
+template <typename T>
+SeqLocking::Array<T>::Array(std::size_t size) :
+    m_size(size),
+    m_values(new std::atomic<T>[size])
+{
+    for (std::size_t i = 0; i < m_size; ++i)
+        m_values[i].store(0, std::memory_order_relaxed);
+}
+
+
+template <typename T>
+void SeqLocking::Array<T>::load(std::size_t pos, std::size_t count, uint8_t* dst) const {
+    for (std::size_t i = 0; i < count; ++i) {
+        const T value = m_values[pos + i].load(std::memory_order_relaxed);
+        std::memcpy(dst + i * sizeof(T), &value, sizeof(T));
+    }
+}
+
+
+template <typename T>
+void SeqLocking::Array<T>::store(std::size_t pos, const uint8_t* src, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        T value;
+        std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+        m_values[pos + i].store(value, std::memory_order_relaxed);
+    }
+}
+
+
+// ServerDevice keeping all four Modbus tables in memory. Coils and discrete inputs are packed
+// bitsets, registers are 64K arrays kept in wire byte order, so a read request is answered with a
+// shift-copy or a memcpy into the response. Each table only serves addresses inside its window,
+// the full address space by default; everything else is answered with ILLEGAL_DATA_ADDRESS.
+//
+// The store*/load* methods give the application access to the tables. Every access locks the
+// table it touches according to LockingPolicy; windows must be set up before the device is served.
+template <typename LockingPolicy>
+class BasicMemoryServerDevice : public ServerDevice {
+public:
+    enum class Table {
+        COILS,
+        DISCRETE_INPUTS,
+        HOLDING_REGISTERS,
+        INPUT_REGISTERS
+    };
+
+    static const std::size_t            NUM_ADDRESSES = 0x10000;
+
+    inline explicit                     BasicMemoryServerDevice(const UnitId& unitId);
+
+    inline void                         setWindow(Table table, const Address& startAddress, std::size_t count);
+
+    inline void                         storeCoils(const Address& startAddress, const uint8_t* values, std::size_t count);
+    inline void                         storeDiscreteInputs(const Address& startAddress, const uint8_t* values, std::size_t count);
+    inline void                         storeHoldingRegisters(const Address& startAddress, const uint16_t* values, std::size_t count);
+    inline void                         storeInputRegisters(const Address& startAddress, const uint16_t* values, std::size_t count);
+
+    inline void                         loadCoils(const Address& startAddress, std::size_t count, uint8_t* values) const;
+    inline void                         loadDiscreteInputs(const Address& startAddress, std::size_t count, uint8_t* values) const;
+    inline void                         loadHoldingRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const;
+    inline void                         loadInputRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const;
+
+protected:
+    inline Status                       readCoil(const Address& address, bool& value) const override;
+    inline Status                       readDiscreteInput(const Address& address, bool& value) const override;
+    inline Status                       readHoldingRegister(const Address& address, uint16_t& value) const override;
+    inline Status                       readInputRegister(const Address& address, uint16_t& value) const override;
+
+    inline Status                       writeCoil(const Address& address, bool value) override;
+    inline Status                       writeRegister(const Address& address, uint16_t value) override;
+    inline Status                       writeCoils(const Address& startAddress, const std::vector<bool>& coils) override;
+    inline Status                       writeRegisters(const Address& startAddress, const std::vector<uint16_t>& regs) override;
+
+    inline Status                       readCoils(const Address& startAddress, std::size_t count, uint8_t* values) const override;
+    inline Status                       readDiscreteInputs(const Address& startAddress, std::size_t count, uint8_t* values) const override;
+    inline Status                       readHoldingRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const override;
+    inline Status                       readInputRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const override;
+
+    inline Status                       readCoilsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const override;
+    inline Status                       readDiscreteInputsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const override;
+    inline Status                       readHoldingRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const override;
+    inline Status                       readInputRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const override;
+
+    inline Status                       writeCoilsPacked(const Address& startAddress, std::size_t count, const uint8_t* packed) override;
+    inline Status                       writeRegistersWire(const Address& startAddress, std::size_t count, const uint8_t* wire) override;
+
+private:
+    using Bits                          = typename LockingPolicy::template Array<uint64_t>;
+    using Registers                     = typename LockingPolicy::template Array<uint16_t>;    // wire byte order
+
+    struct Window {
+        std::size_t                     begin;
+        std::size_t                     end;
+    };
+
+    Bits                                m_coils;
+    Bits                                m_discreteInputs;
+    Registers                           m_holdingRegisters;
+    Registers                           m_inputRegisters;
+    Window                              m_windows[4];
+    mutable typename LockingPolicy::Lock m_locks[4];
+
+    inline bool                         isInWindow(Table table, std::size_t start, std::size_t count) const;
+    inline typename LockingPolicy::Lock& getLock(Table table) const;
+    inline static void                  checkRange(std::size_t start, std::size_t count);
+
+    inline static bool                  getBit(const Bits& bits, std::size_t pos);
+    inline static void                  setBit(Bits& bits, std::size_t pos, bool value);
+    inline static void                  storeBits(Bits& bits, std::size_t start, const uint8_t* values, std::size_t count);
+    inline static void                  loadBits(const Bits& bits, std::size_t start, std::size_t count, uint8_t* values);
+    inline static void                  copyPacked(const Bits& bits, std::size_t start, std::size_t count, uint8_t* packed);
+    inline static void                  storePacked(Bits& bits, std::size_t start, const uint8_t* packed, std::size_t count);
+
+    inline static void                  storeRegisters(Registers& regs, std::size_t start, const uint16_t* values, std::size_t count);
+    inline static void                  loadRegisters(const Registers& regs, std::size_t start, std::size_t count, uint16_t* values);
+};
+
+
+using MemoryServerDevice = BasicMemoryServerDevice<NoLocking>;
+
+
+template <typename LockingPolicy>
+BasicMemoryServerDevice<LockingPolicy>::BasicMemoryServerDevice(const UnitId& unitId) :
+    ServerDevice(unitId),
+    m_coils(NUM_ADDRESSES / 64),
+    m_discreteInputs(NUM_ADDRESSES / 64),
+    m_holdingRegisters(NUM_ADDRESSES),
+    m_inputRegisters(NUM_ADDRESSES)
+{
+    for (auto& window: m_windows)
+        window = Window{0, NUM_ADDRESSES};
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::setWindow(Table table, const Address& startAddress, std::size_t count) {
+    checkRange(startAddress.get(), count);
+    m_windows[static_cast<std::size_t>(table)] = Window{startAddress.get(), startAddress.get() + count};
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storeCoils(const Address& startAddress, const uint8_t* values, std::size_t count) {
+    checkRange(startAddress.get(), count);
+    getLock(Table::COILS).write([&]() { storeBits(m_coils, startAddress.get(), values, count); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storeDiscreteInputs(const Address& startAddress, const uint8_t* values, std::size_t count) {
+    checkRange(startAddress.get(), count);
+    getLock(Table::DISCRETE_INPUTS).write([&]() { storeBits(m_discreteInputs, startAddress.get(), values, count); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storeHoldingRegisters(const Address& startAddress, const uint16_t* values, std::size_t count) {
+    checkRange(startAddress.get(), count);
+    getLock(Table::HOLDING_REGISTERS).write([&]() { storeRegisters(m_holdingRegisters, startAddress.get(), values, count); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storeInputRegisters(const Address& startAddress, const uint16_t* values, std::size_t count) {
+    checkRange(startAddress.get(), count);
+    getLock(Table::INPUT_REGISTERS).write([&]() { storeRegisters(m_inputRegisters, startAddress.get(), values, count); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::loadCoils(const Address& startAddress, std::size_t count, uint8_t* values) const {
+    checkRange(startAddress.get(), count);
+    getLock(Table::COILS).read([&]() { loadBits(m_coils, startAddress.get(), count, values); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::loadDiscreteInputs(const Address& startAddress, std::size_t count, uint8_t* values) const {
+    checkRange(startAddress.get(), count);
+    getLock(Table::DISCRETE_INPUTS).read([&]() { loadBits(m_discreteInputs, startAddress.get(), count, values); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::loadHoldingRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const {
+    checkRange(startAddress.get(), count);
+    getLock(Table::HOLDING_REGISTERS).read([&]() { loadRegisters(m_holdingRegisters, startAddress.get(), count, values); });
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::loadInputRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const {
+    checkRange(startAddress.get(), count);
+    getLock(Table::INPUT_REGISTERS).read([&]() { loadRegisters(m_inputRegisters, startAddress.get(), count, values); });
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readCoil(const Address& address, bool& value) const {
+    if (!isInWindow(Table::COILS, address.get(), 1))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::COILS).read([&]() { value = getBit(m_coils, address.get()); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readDiscreteInput(const Address& address, bool& value) const {
+    if (!isInWindow(Table::DISCRETE_INPUTS, address.get(), 1))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::DISCRETE_INPUTS).read([&]() { value = getBit(m_discreteInputs, address.get()); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readHoldingRegister(const Address& address, uint16_t& value) const {
+    return readHoldingRegisters(address, 1, &value);
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readInputRegister(const Address& address, uint16_t& value) const {
+    return readInputRegisters(address, 1, &value);
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::writeCoil(const Address& address, bool value) {
+    if (!isInWindow(Table::COILS, address.get(), 1))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::COILS).write([&]() { setBit(m_coils, address.get(), value); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::writeRegister(const Address& address, uint16_t value) {
+    if (!isInWindow(Table::HOLDING_REGISTERS, address.get(), 1))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::HOLDING_REGISTERS).write([&]() { storeRegisters(m_holdingRegisters, address.get(), &value, 1); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::writeCoils(const Address& startAddress, const std::vector<bool>& coils) {
+    if (!isInWindow(Table::COILS, startAddress.get(), coils.size()))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::COILS).write([&]() {
+        for (std::size_t i = 0; i < coils.size(); ++i)
+            setBit(m_coils, startAddress.get() + i, coils[i]);
+    });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::writeRegisters(const Address& startAddress, const std::vector<uint16_t>& regs) {
+    if (!isInWindow(Table::HOLDING_REGISTERS, startAddress.get(), regs.size()))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::HOLDING_REGISTERS).write([&]() { storeRegisters(m_holdingRegisters, startAddress.get(), regs.data(), regs.size()); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readCoils(const Address& startAddress, std::size_t count, uint8_t* values) const {
+    if (!isInWindow(Table::COILS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::COILS).read([&]() { loadBits(m_coils, startAddress.get(), count, values); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readDiscreteInputs(const Address& startAddress, std::size_t count, uint8_t* values) const {
+    if (!isInWindow(Table::DISCRETE_INPUTS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::DISCRETE_INPUTS).read([&]() { loadBits(m_discreteInputs, startAddress.get(), count, values); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readHoldingRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const {
+    if (!isInWindow(Table::HOLDING_REGISTERS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::HOLDING_REGISTERS).read([&]() { loadRegisters(m_holdingRegisters, startAddress.get(), count, values); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readInputRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const {
+    if (!isInWindow(Table::INPUT_REGISTERS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::INPUT_REGISTERS).read([&]() { loadRegisters(m_inputRegisters, startAddress.get(), count, values); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readCoilsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const {
+    if (!isInWindow(Table::COILS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::COILS).read([&]() { copyPacked(m_coils, startAddress.get(), count, packed); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readDiscreteInputsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const {
+    if (!isInWindow(Table::DISCRETE_INPUTS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::DISCRETE_INPUTS).read([&]() { copyPacked(m_discreteInputs, startAddress.get(), count, packed); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readHoldingRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const {
+    if (!isInWindow(Table::HOLDING_REGISTERS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::HOLDING_REGISTERS).read([&]() { m_holdingRegisters.load(startAddress.get(), count, wire); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::readInputRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const {
+    if (!isInWindow(Table::INPUT_REGISTERS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::INPUT_REGISTERS).read([&]() { m_inputRegisters.load(startAddress.get(), count, wire); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::writeCoilsPacked(const Address& startAddress, std::size_t count, const uint8_t* packed) {
+    if (!isInWindow(Table::COILS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    getLock(Table::COILS).write([&]() { storePacked(m_coils, startAddress.get(), packed, count); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+Status BasicMemoryServerDevice<LockingPolicy>::writeRegistersWire(const Address& startAddress, std::size_t count, const uint8_t* wire) {
+    if (!isInWindow(Table::HOLDING_REGISTERS, startAddress.get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    // the table is kept in wire order, the payload is copied as is
+    getLock(Table::HOLDING_REGISTERS).write([&]() { m_holdingRegisters.store(startAddress.get(), wire, count); });
+    return Status::OK;
+}
+
+
+template <typename LockingPolicy>
+typename LockingPolicy::Lock& BasicMemoryServerDevice<LockingPolicy>::getLock(Table table) const {
+    return m_locks[static_cast<std::size_t>(table)];
+}
+
+
+template <typename LockingPolicy>
+bool BasicMemoryServerDevice<LockingPolicy>::isInWindow(Table table, std::size_t start, std::size_t count) const {
+    const Window& window = m_windows[static_cast<std::size_t>(table)];
+    return start >= window.begin && start + count <= window.end;
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::checkRange(std::size_t start, std::size_t count) {
+    if (start + count > NUM_ADDRESSES)
+        throw std::out_of_range("address range exceeds the modbus address space");
+}
+
+
+template <typename LockingPolicy>
+bool BasicMemoryServerDevice<LockingPolicy>::getBit(const Bits& bits, std::size_t pos) {
+    return (bits.load(pos / 64) >> (pos % 64)) & 1;
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::setBit(Bits& bits, std::size_t pos, bool value) {
+    const uint64_t mask = uint64_t(1) << (pos % 64);
+    const uint64_t word = bits.load(pos / 64);
+
+    bits.store(pos / 64, value ? (word | mask) : (word & ~mask));
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storeBits(Bits& bits, std::size_t start, const uint8_t* values, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i)
+        setBit(bits, start + i, values[i] != 0);
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::loadBits(const Bits& bits, std::size_t start, std::size_t count, uint8_t* values) {
+    uint8_t packed[NUM_ADDRESSES / 8];
+
+    copyPacked(bits, start, count, packed);
+    unpackBits(packed, count, values);
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::copyPacked(const Bits& bits, std::size_t start, std::size_t count, uint8_t* packed) {
+    const std::size_t numBytes = (count + 7) / 8;
+
+    // one output byte per step: shift the 8 bits down from the word holding them, borrowing from
+    // the next word when they straddle a word boundary
+    for (std::size_t i = 0; i < numBytes; ++i) {
+        const std::size_t pos = start + 8*i;
+        const std::size_t word = pos / 64;
+        const std::size_t shift = pos % 64;
+
+        uint64_t value = bits.load(word) >> shift;
+
+        if (shift > 56 && word + 1 < bits.size())
+            value |= bits.load(word + 1) << (64 - shift);
+
+        packed[i] = value & 0xff;
+    }
+
+    if (count % 8 != 0)
+        packed[numBytes - 1] &= (1 << (count % 8)) - 1;
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storePacked(Bits& bits, std::size_t start, const uint8_t* packed, std::size_t count) {
+    const std::size_t numBytes = (count + 7) / 8;
+
+    // one table word per step: gather the bits that land in it, 8 at a time, and merge them in
+    for (std::size_t i = 0; i < count;) {
+        const std::size_t pos = start + i;
+        const std::size_t shift = pos % 64;
+        const std::size_t n = std::min<std::size_t>(64 - shift, count - i);
+
+        uint64_t value = 0;
+
+        for (std::size_t k = 0; k < n; k += 8) {
+            const std::size_t byte = (i + k) / 8;
+            const std::size_t offset = (i + k) % 8;
+            uint16_t two = packed[byte];
+
+            if (byte + 1 < numBytes)
+                two |= packed[byte + 1] << 8;
+
+            value |= uint64_t((two >> offset) & 0xff) << k;
+        }
+
+        const uint64_t mask = (n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1) << shift;
+        const uint64_t word = bits.load(pos / 64);
+
+        bits.store(pos / 64, (word & ~mask) | ((value << shift) & mask));
+        i += n;
+    }
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::storeRegisters(Registers& regs, std::size_t start, const uint16_t* values, std::size_t count) {
+    // converted to wire order in chunks, so that the bulk kernels stay in use
+    uint8_t wire[2 * MODBUS_MAX_NUM_REGS_IN_READ_REQUEST];
+
+    for (std::size_t done = 0; done < count; done += MODBUS_MAX_NUM_REGS_IN_READ_REQUEST) {
+        const std::size_t n = std::min<std::size_t>(count - done, MODBUS_MAX_NUM_REGS_IN_READ_REQUEST);
+
+        encodeRegisters(values + done, n, wire);
+        regs.store(start + done, wire, n);
+    }
+}
+
+
+template <typename LockingPolicy>
+void BasicMemoryServerDevice<LockingPolicy>::loadRegisters(const Registers& regs, std::size_t start, std::size_t count, uint16_t* values) {
+    uint8_t wire[2 * MODBUS_MAX_NUM_REGS_IN_READ_REQUEST];
+
+    for (std::size_t done = 0; done < count; done += MODBUS_MAX_NUM_REGS_IN_READ_REQUEST) {
+        const std::size_t n = std::min<std::size_t>(count - done, MODBUS_MAX_NUM_REGS_IN_READ_REQUEST);
+
+        regs.load(start + done, n, wire);
+        decodeRegisters(wire, n, values + done);
+    }
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
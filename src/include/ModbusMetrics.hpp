@@ -0,0 +1,551 @@
+#ifndef MODBUS_METRICS_HPP
+#define MODBUS_METRICS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace modbus {
+
+// Log linear histogram in the style of HdrHistogram: every power of two is split into
+// SUB_BUCKETS linear buckets, so any value is stored with a relative error below 1 / SUB_BUCKETS
+// and the whole uint64_t range fits into a fixed number of buckets. Values are nanoseconds.
+class LatencyHistogram {
+public:
+    static const std::size_t                SUB_BUCKETS = 8;
+    static const std::size_t                NUM_BUCKETS = SUB_BUCKETS * 62;
+
+    inline                                  LatencyHistogram();
+
+    inline void                             record(uint64_t value);
+    inline void                             merge(const LatencyHistogram& other);
+
+    inline uint64_t                         getCount() const;
+    inline uint64_t                         getSum() const;
+    inline uint64_t                         getMax() const;
+
+    // Highest value equivalent to the one at quantile q in [0, 1], zero when empty.
+    inline uint64_t                         getPercentile(double q) const;
+
+    static inline std::size_t               getBucket(uint64_t value);
+    static inline uint64_t                  getBucketUpperBound(std::size_t bucket);
+
+private:
+    friend class Metrics;
+
+    std::vector<uint64_t>                   m_counts;
+    uint64_t                                m_count;
+    uint64_t                                m_sum;
+    uint64_t                                m_max;
+};
+
+
+struct MetricsSnapshot {
+    struct Counters {
+                                            Counters() : requests(0), exceptions(0), bytesReceived(0), bytesSent(0) {}
+
+        uint64_t                            requests;
+        uint64_t                            exceptions;         // exception responses
+        uint64_t                            bytesReceived;
+        uint64_t                            bytesSent;
+    };
+
+    struct FunctionCodeMetrics : Counters {
+        LatencyHistogram                    latency;
+    };
+
+    struct ConnectionMetrics : Counters {
+        std::string                         peer;
+    };
+
+    // by function code, without the exception bit
+    std::map<uint8_t, FunctionCodeMetrics>  served;             // latency is the ServerDevice service time
+    std::map<uint8_t, FunctionCodeMetrics>  polled;             // latency is the poll round trip time
+    std::vector<ConnectionMetrics>          connections;        // open server connections
+};
+
+
+// Counters and latency histograms shared by any number of servers and pollers on any number of
+// threads. Each thread records into a shard of its own with plain stores, so recording takes no
+// lock past a thread's first record and shares no cache line with other threads; shards are merged
+// when a snapshot is taken.
+class Metrics {
+public:
+    using Duration                          = std::chrono::nanoseconds;
+
+    // Counters of one server connection, recorded by the thread running the session.
+    class Connection {
+    public:
+        inline explicit                     Connection(const std::string& peer);
+
+        inline void                         record(std::size_t bytesReceived, std::size_t bytesSent, bool exception);
+
+    private:
+        friend class Metrics;
+
+        std::string                         m_peer;
+        std::atomic<uint64_t>               m_requests;
+        std::atomic<uint64_t>               m_exceptions;
+        std::atomic<uint64_t>               m_bytesReceived;
+        std::atomic<uint64_t>               m_bytesSent;
+    };
+
+    inline                                  Metrics();
+
+                                            Metrics(const Metrics&) = delete;
+    Metrics&                                operator=(const Metrics&) = delete;
+
+    inline void                             recordServed(uint8_t functionCode, std::size_t bytesReceived, std::size_t bytesSent, bool exception, const Duration& serviceTime);
+    inline void                             recordPolled(uint8_t functionCode, std::size_t bytesReceived, std::size_t bytesSent, bool exception, const Duration& roundTrip);
+
+    // The connection stays valid until it is closed.
+    inline Connection*                      openConnection(const std::string& peer);
+    inline void                             closeConnection(Connection* connection);
+
+    inline MetricsSnapshot                  getSnapshot() const;
+
+private:
+    enum Source { SERVED, POLLED, NUM_SOURCES };
+
+    static const std::size_t                NUM_FUNCTION_CODES = 0x80;
+    static const std::size_t                NUM_CACHED_SHARDS = 8;      // instances per thread found without the lock
+
+    // only written by the thread owning the shard, hence load and store instead of fetch_add
+    struct Histogram {
+        std::atomic<uint64_t>               counts[LatencyHistogram::NUM_BUCKETS];
+        std::atomic<uint64_t>               sum;
+        std::atomic<uint64_t>               max;
+
+        inline                              Histogram();
+    };
+
+    struct Entry {
+        std::atomic<uint64_t>               requests;
+        std::atomic<uint64_t>               exceptions;
+        std::atomic<uint64_t>               bytesReceived;
+        std::atomic<uint64_t>               bytesSent;
+        std::atomic<Histogram*>             latency;            // allocated on first use
+    };
+
+    struct Shard {
+        Entry                               entries[NUM_SOURCES][NUM_FUNCTION_CODES];
+
+        inline                              Shard();
+        inline                             ~Shard();
+    };
+
+    const uint64_t                          m_id;               // tells apart instances in the per thread shard cache
+    mutable std::mutex                      m_mutex;
+    std::map<std::thread::id, std::unique_ptr<Shard>> m_shards;
+    std::list<Connection>                   m_connections;
+
+    inline void                             record(Source source, uint8_t functionCode, std::size_t bytesReceived, std::size_t bytesSent, bool exception, const Duration& latency);
+    inline Shard&                           getShard();
+
+    static inline uint64_t                  nextId();
+    static inline void                      add(std::atomic<uint64_t>& counter, uint64_t value);
+    static inline void                      merge(MetricsSnapshot::Counters& counters, const Entry& entry);
+};
+
+
+// Writes the snapshot in the Prometheus text exposition format, latencies as summaries in seconds.
+inline void writePrometheus(std::ostream& os, const MetricsSnapshot& snapshot);
+
+// Replaces the file through a rename, so a collector never reads a partial file.
+inline void writePrometheusFile(const std::string& path, const MetricsSnapshot& snapshot);
+
+
+LatencyHistogram::LatencyHistogram() :
+    m_counts(NUM_BUCKETS, 0),
+    m_count(0),
+    m_sum(0),
+    m_max(0)
+{}
+
+
+void LatencyHistogram::record(uint64_t value) {
+    ++m_counts[getBucket(value)];
+    ++m_count;
+    m_sum += value;
+    m_max = std::max(m_max, value);
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (std::size_t i = 0; i < NUM_BUCKETS; ++i)
+        m_counts[i] += other.m_counts[i];
+
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max(m_max, other.m_max);
+}
+
+
+uint64_t LatencyHistogram::getCount() const {
+    return m_count;
+}
+
+
+uint64_t LatencyHistogram::getSum() const {
+    return m_sum;
+}
+
+
+uint64_t LatencyHistogram::getMax() const {
+    return m_max;
+}
+
+
+uint64_t LatencyHistogram::getPercentile(double q) const {
+    if (m_count == 0)
+        return 0;
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * m_count + 0.5));
+    uint64_t seen = 0;
+
+    for (std::size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += m_counts[i];
+
+        if (seen >= rank)
+            return std::min(getBucketUpperBound(i), m_max);
+    }
+
+    return m_max;
+}
+
+
+std::size_t LatencyHistogram::getBucket(uint64_t value) {
+    if (value < SUB_BUCKETS)
+        return value;
+
+    // position of the highest bit, at least 3 here
+    std::size_t msb = 0;
+#if defined(__GNUC__)
+    msb = 63 - __builtin_clzll(value);
+#else
+    for (uint64_t v = value; v >>= 1; )
+        ++msb;
+#endif
+
+    return SUB_BUCKETS * (msb - 2) + ((value >> (msb - 3)) & (SUB_BUCKETS - 1));
+}
+
+
+uint64_t LatencyHistogram::getBucketUpperBound(std::size_t bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    const std::size_t shift = bucket / SUB_BUCKETS - 1;
+    const uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+
+Metrics::Connection::Connection(const std::string& peer) :
+    m_peer(peer),
+    m_requests(0),
+    m_exceptions(0),
+    m_bytesReceived(0),
+    m_bytesSent(0)
+{}
+
+
+void Metrics::Connection::record(std::size_t bytesReceived, std::size_t bytesSent, bool exception) {
+    add(m_requests, 1);
+    add(m_bytesReceived, bytesReceived);
+    add(m_bytesSent, bytesSent);
+
+    if (exception)
+        add(m_exceptions, 1);
+}
+
+
+Metrics::Histogram::Histogram() {
+    for (auto& count: counts)
+        count.store(0, std::memory_order_relaxed);
+
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+
+Metrics::Shard::Shard() {
+    for (auto& source: entries) {
+        for (auto& entry: source) {
+            entry.requests.store(0, std::memory_order_relaxed);
+            entry.exceptions.store(0, std::memory_order_relaxed);
+            entry.bytesReceived.store(0, std::memory_order_relaxed);
+            entry.bytesSent.store(0, std::memory_order_relaxed);
+            entry.latency.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+}
+
+
+Metrics::Shard::~Shard() {
+    for (auto& source: entries) {
+        for (auto& entry: source)
+            delete entry.latency.load(std::memory_order_relaxed);
+    }
+}
+
+
+Metrics::Metrics() :
+    m_id(nextId()),
+    m_mutex(),
+    m_shards(),
+    m_connections()
+{}
+
+
+void Metrics::recordServed(uint8_t functionCode, std::size_t bytesReceived, std::size_t bytesSent, bool exception, const Duration& serviceTime) {
+    record(SERVED, functionCode, bytesReceived, bytesSent, exception, serviceTime);
+}
+
+
+void Metrics::recordPolled(uint8_t functionCode, std::size_t bytesReceived, std::size_t bytesSent, bool exception, const Duration& roundTrip) {
+    record(POLLED, functionCode, bytesReceived, bytesSent, exception, roundTrip);
+}
+
+
+Metrics::Connection* Metrics::openConnection(const std::string& peer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_connections.emplace_back(peer);
+    return &m_connections.back();
+}
+
+
+void Metrics::closeConnection(Connection* connection) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        if (&*it == connection) {
+            m_connections.erase(it);
+            return;
+        }
+    }
+}
+
+
+MetricsSnapshot Metrics::getSnapshot() const {
+    MetricsSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto& shard: m_shards) {
+        for (std::size_t source = 0; source < NUM_SOURCES; ++source) {
+            auto& target = source == SERVED ? snapshot.served : snapshot.polled;
+
+            for (std::size_t functionCode = 0; functionCode < NUM_FUNCTION_CODES; ++functionCode) {
+                const Entry& entry = shard.second->entries[source][functionCode];
+                const Histogram* latency = entry.latency.load(std::memory_order_acquire);
+
+                if (latency == nullptr)
+                    continue;
+
+                MetricsSnapshot::FunctionCodeMetrics& metrics = target[functionCode];
+                LatencyHistogram& histogram = metrics.latency;
+
+                merge(metrics, entry);
+
+                for (std::size_t i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+                    const uint64_t count = latency->counts[i].load(std::memory_order_relaxed);
+
+                    histogram.m_counts[i] += count;
+                    histogram.m_count += count;
+                }
+
+                histogram.m_sum += latency->sum.load(std::memory_order_relaxed);
+                histogram.m_max = std::max(histogram.m_max, latency->max.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    for (const auto& connection: m_connections) {
+        snapshot.connections.emplace_back();
+        snapshot.connections.back().peer = connection.m_peer;
+        snapshot.connections.back().requests = connection.m_requests.load(std::memory_order_relaxed);
+        snapshot.connections.back().exceptions = connection.m_exceptions.load(std::memory_order_relaxed);
+        snapshot.connections.back().bytesReceived = connection.m_bytesReceived.load(std::memory_order_relaxed);
+        snapshot.connections.back().bytesSent = connection.m_bytesSent.load(std::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+
+void Metrics::record(Source source, uint8_t functionCode, std::size_t bytesReceived, std::size_t bytesSent, bool exception, const Duration& latency) {
+    Entry& entry = getShard().entries[source][functionCode & (NUM_FUNCTION_CODES - 1)];
+    Histogram* histogram = entry.latency.load(std::memory_order_relaxed);
+
+    if (histogram == nullptr) {
+        histogram = new Histogram();
+        entry.latency.store(histogram, std::memory_order_release);
+    }
+
+    add(entry.requests, 1);
+    add(entry.bytesReceived, bytesReceived);
+    add(entry.bytesSent, bytesSent);
+
+    if (exception)
+        add(entry.exceptions, 1);
+
+    const uint64_t value = latency.count() > 0 ? latency.count() : 0;
+
+    add(histogram->counts[LatencyHistogram::getBucket(value)], 1);
+    add(histogram->sum, value);
+
+    if (value > histogram->max.load(std::memory_order_relaxed))
+        histogram->max.store(value, std::memory_order_relaxed);
+}
+
+
+Metrics::Shard& Metrics::getShard() {
+    // A few slots per thread, most recently used first, so that a thread recording into several
+    // instances in turn (a server and a poller, say) takes each one's lock only once. Ids are never
+    // reused, so slots of destroyed instances are never hit and just age out.
+    struct Slot {
+        uint64_t                            id;
+        Shard*                              shard;
+    };
+
+    static thread_local Slot cache[NUM_CACHED_SHARDS] = {};
+
+    for (std::size_t i = 0; i < NUM_CACHED_SHARDS; ++i) {
+        if (cache[i].id == m_id) {
+            const Slot hit = cache[i];
+
+            std::copy_backward(cache, cache + i, cache + i + 1);
+            cache[0] = hit;
+
+            return *hit.shard;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Shard>& shard = m_shards[std::this_thread::get_id()];
+
+    if (!shard)
+        shard.reset(new Shard());
+
+    std::copy_backward(cache, cache + NUM_CACHED_SHARDS - 1, cache + NUM_CACHED_SHARDS);
+    cache[0] = Slot{m_id, shard.get()};
+
+    return *shard;
+}
+
+
+uint64_t Metrics::nextId() {
+    static std::atomic<uint64_t> id(0);
+    return ++id;
+}
+
+
+void Metrics::add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+void Metrics::merge(MetricsSnapshot::Counters& counters, const Entry& entry) {
+    counters.requests += entry.requests.load(std::memory_order_relaxed);
+    counters.exceptions += entry.exceptions.load(std::memory_order_relaxed);
+    counters.bytesReceived += entry.bytesReceived.load(std::memory_order_relaxed);
+    counters.bytesSent += entry.bytesSent.load(std::memory_order_relaxed);
+}
+
+
+namespace detail {
+
+using CounterField = uint64_t MetricsSnapshot::Counters::*;
+
+struct PrometheusCounter {
+    const char*                             name;
+    CounterField                            field;
+};
+
+inline const std::vector<PrometheusCounter>& getPrometheusCounters() {
+    static const std::vector<PrometheusCounter> counters = {
+        {"requests_total",          &MetricsSnapshot::Counters::requests},
+        {"exceptions_total",        &MetricsSnapshot::Counters::exceptions},
+        {"received_bytes_total",    &MetricsSnapshot::Counters::bytesReceived},
+        {"sent_bytes_total",        &MetricsSnapshot::Counters::bytesSent}
+    };
+
+    return counters;
+}
+
+
+inline void writePrometheusFunctionCodes(std::ostream& os, const std::string& prefix, const std::string& latency, const std::map<uint8_t, MetricsSnapshot::FunctionCodeMetrics>& metrics) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    // the samples of one metric have to be grouped together
+    for (const auto& counter: getPrometheusCounters()) {
+        os << "# TYPE " << prefix << '_' << counter.name << " counter\n";
+
+        for (const auto& entry: metrics)
+            os << prefix << '_' << counter.name << "{function_code=\"" << int(entry.first) << "\"} " << entry.second.*counter.field << '\n';
+    }
+
+    const std::string name = prefix + '_' + latency + "_seconds";
+
+    os << "# TYPE " << name << " summary\n";
+
+    for (const auto& entry: metrics) {
+        const LatencyHistogram& histogram = entry.second.latency;
+        const int functionCode = entry.first;
+
+        for (double q: quantiles)
+            os << name << "{function_code=\"" << functionCode << "\",quantile=\"" << q << "\"} " << histogram.getPercentile(q) * 1e-9 << '\n';
+
+        os << name << "_sum{function_code=\"" << functionCode << "\"} " << histogram.getSum() * 1e-9 << '\n';
+        os << name << "_count{function_code=\"" << functionCode << "\"} " << histogram.getCount() << '\n';
+    }
+}
+
+} // namespace detail
+
+
+void writePrometheus(std::ostream& os, const MetricsSnapshot& snapshot) {
+    detail::writePrometheusFunctionCodes(os, "modbus_server", "service_time", snapshot.served);
+    detail::writePrometheusFunctionCodes(os, "modbus_poller", "round_trip", snapshot.polled);
+
+    for (const auto& counter: detail::getPrometheusCounters()) {
+        os << "# TYPE modbus_connection_" << counter.name << " counter\n";
+
+        for (const auto& connection: snapshot.connections)
+            os << "modbus_connection_" << counter.name << "{peer=\"" << connection.peer << "\"} " << connection.*counter.field << '\n';
+    }
+}
+
+
+void writePrometheusFile(const std::string& path, const MetricsSnapshot& snapshot) {
+    const std::string tmp = path + ".tmp";
+
+    std::ofstream file(tmp, std::ios::trunc);
+    writePrometheus(file, snapshot);
+    file.close();
+
+    if (!file)
+        throw std::runtime_error("writing " + tmp + " failed");
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("renaming " + tmp + " to " + path + " failed");
+}
+
+} // namespace modbus
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef MODBUS_POLL_TASK_HPP
 #define MODBUS_POLL_TASK_HPP
 
+#include "ModbusLog.hpp"
+
 
 template <typename ModbusPoller>
 class ModbusPollTask : public std::enable_shared_from_this<ModbusPollTask<ModbusPoller>> {
@@ -9,134 +11,90 @@ public:
     using Vector                            = std::vector<uint8_t>;
     using PollCallback                      = std::function<void(void)>;
 
-                                            ModbusPollTask(std::shared_ptr<ModbusPoller> owner, const Vector& req, Vector& rsp, const Interval& interval, PollCallback pollCb);
+                                            ModbusPollTask(const Vector& req, Vector& rsp, const Interval& interval, PollCallback pollCb);
                                            ~ModbusPollTask();
 
-    void                                    start();
-    void                                    cancel();
-    void                                    asyncModbusDialog(boost::asio::ip::tcp::socket* sock);
+    const Interval&                         getInterval() const;
+    bool                                    isQueued() const;
+    void                                    setQueued(bool queued);
+
+    const Vector&                           getRequest() const;
+    const Vector&                           getRequest(const modbus::tcp::TransactionId& transactionId);
+    void                                    onResponse(const uint8_t* rsp, std::size_t size);
 
 private:
-    std::shared_ptr<ModbusPoller>           m_owner;
     Vector                                  m_req;
     Vector                                 &m_rsp;
     Interval                                m_interval;
     PollCallback                            m_pollCb;
-    boost::asio::deadline_timer             m_timer;
-    boost::asio::ip::tcp::socket           *m_socket;
-
-    void                                    initTimer();
-
-    void                                    initHeaderReception();
-    void                                    initPayloadReception();
-    void                                    onPayloadReceived();
-
+    modbus::tcp::TransactionId              m_transactionId;
+    bool                                    m_queued;
 };
 
 
 template <typename ModbusPoller>
-ModbusPollTask<ModbusPoller>::ModbusPollTask(std::shared_ptr<ModbusPoller> owner, const Vector& req, Vector& rsp, const Interval& interval, PollCallback pollCb) :
-    m_owner(owner),
+ModbusPollTask<ModbusPoller>::ModbusPollTask(const Vector& req, Vector& rsp, const Interval& interval, PollCallback pollCb) :
     m_req(req),
     m_rsp(rsp),
     m_interval(interval),
     m_pollCb(pollCb),
-    m_timer(owner->get_io_service())
+    m_transactionId(modbus::tcp::decoder_views::Header(req).getTransactionId()),
+    m_queued(false)
 {
-    std::cout << "ModbusPollTask:" << this << std::endl;
+    MODBUS_LOG_DEBUG("ModbusPollTask " << this);
 }
 
 
 template <typename ModbusPoller>
 ModbusPollTask<ModbusPoller>::~ModbusPollTask() {
-    std::cout << "~ModbusPollTask:" << this << std::endl;
+    MODBUS_LOG_DEBUG("~ModbusPollTask " << this);
 }
 
 
 template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::start() {
-    m_owner->enque(this->shared_from_this());
-    initTimer();
+const typename ModbusPollTask<ModbusPoller>::Interval& ModbusPollTask<ModbusPoller>::getInterval() const {
+    return m_interval;
 }
 
 
 template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::initTimer() {
-    auto self = this->shared_from_this();
-
-    m_timer.expires_from_now(m_interval);
-    m_timer.async_wait([self, this](const boost::system::error_code& ec) {
-        if (ec)
-            return;
-
-        m_owner->enque(self);
-        initTimer();
-    });
+bool ModbusPollTask<ModbusPoller>::isQueued() const {
+    return m_queued;
 }
 
 
 template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::asyncModbusDialog(boost::asio::ip::tcp::socket* sock) {
-    auto self = this->shared_from_this();
-    m_socket = sock;
-
-    boost::asio::async_write(*m_socket, boost::asio::buffer(m_req), [self, this](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
-        if (ec)
-            m_owner->handleModbusDialogDone(ec);
-        else
-            initHeaderReception();
-    });
+void ModbusPollTask<ModbusPoller>::setQueued(bool queued) {
+    m_queued = queued;
 }
 
 
 template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::initHeaderReception() {
-    m_rsp.resize(sizeof(modbus::tcp::Header));
-
-    auto self = this->shared_from_this();
-
-    boost::asio::async_read(*m_socket, boost::asio::buffer(m_rsp), [self, this](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
-        if (ec)
-            m_owner->handleModbusDialogDone(ec);
-        else
-            initPayloadReception();
-    });
+const typename ModbusPollTask<ModbusPoller>::Vector& ModbusPollTask<ModbusPoller>::getRequest() const {
+    return m_req;
 }
 
 
 template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::initPayloadReception() {
-    modbus::tcp::decoder_views::Header rsp_header_view(m_rsp);
-    std::size_t payloadSize = rsp_header_view.getLength() - 2;
-    
-    m_rsp.resize(sizeof(modbus::tcp::Header) + payloadSize);
-
-    uint8_t* payload = m_rsp.data() + sizeof(modbus::tcp::Header);
-
-    auto self = this->shared_from_this();
-
-    boost::asio::async_read(*m_socket, boost::asio::buffer(payload, payloadSize), [self, this](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
-        if (ec)
-            m_owner->handleModbusDialogDone(ec);
-        else
-            onPayloadReceived();
-    });
+const typename ModbusPollTask<ModbusPoller>::Vector& ModbusPollTask<ModbusPoller>::getRequest(const modbus::tcp::TransactionId& transactionId) {
+    auto* header = reinterpret_cast<modbus::tcp::Header*>(m_req.data());
+    header->transactionId = htons(transactionId.get());
+
+    return m_req;
 }
 
 
 template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::onPayloadReceived() {
-    m_pollCb();
-    m_owner->handleModbusDialogDone();
-}
+void ModbusPollTask<ModbusPoller>::onResponse(const uint8_t* rsp, std::size_t size) {
+    m_rsp.assign(rsp, rsp + size);
 
+    // the poller stamps its own transaction ids on the wire, hand back the one the caller encoded
+    auto* header = reinterpret_cast<modbus::tcp::Header*>(m_rsp.data());
+    header->transactionId = htons(m_transactionId.get());
 
-template <typename ModbusPoller>
-void ModbusPollTask<ModbusPoller>::cancel() {
-    m_timer.cancel();
+    m_pollCb();
 }
 
 
-
 #endif
 
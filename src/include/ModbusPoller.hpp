@@ -1,8 +1,20 @@
+
 #ifndef MODBUS_POLLER_HPP
 #define MODBUS_POLLER_HPP
 
 
+#include "ModbusLog.hpp"
+#include "ModbusMetrics.hpp"
+#include "ModbusRegisterImage.hpp"
+#include "ModbusFrameValidator.hpp"
+
 #include <list>
+#include <map>
+#include <cstring>
+#include <algorithm>
+#include <queue>
+#include <atomic>
+#include <chrono>
 
 
 class ModbusPoller : public std::enable_shared_from_this<ModbusPoller> {
@@ -11,23 +23,92 @@ public:
     using Vector                                = std::vector<uint8_t>;
     using PollCallback                          = std::function<void(void)>;
 
+    struct Stats {
+        uint64_t                                numTransactions;
+        uint64_t                                numResponses;
+        uint64_t                                numSkippedPolls;
+        uint64_t                                numConnectionErrors;
+    };
+
                                                 ModbusPoller(boost::asio::io_service& io, const SocketConnector::Endpoint& ep, const Interval& reconnectInterval);
                                                ~ModbusPoller();
 
     void                                        addPollTask(const Vector& req, Vector& rsp, const Interval& interval, PollCallback cb);
+    std::shared_ptr<ModbusRegisterImage>        addPollTask(const Vector& req, const Interval& interval);
+    void                                        setMaxRequestsInFlight(std::size_t maxRequestsInFlight);
+    void                                        setRequestCoalescing(bool enabled);
+
+    // Record the round trip time of each transaction into metrics, which must outlive the poller.
+    void                                        setMetrics(modbus::Metrics* metrics);
     void                                        start();
+
+    // Stop polling and drop the connection. The poll tasks are kept, so that start() resumes them.
+    void                                        stop();
     void                                        cancel();
 
+    Stats                                       getStats() const;
+    double                                      getPollRate() const;
+
 private:
     using Task                                  = ModbusPollTask<ModbusPoller>;
     using PTask                                 = std::shared_ptr<Task>;
+    using Time                                  = boost::posix_time::ptime;
+    using Clock                                 = std::chrono::steady_clock;
     friend class ModbusPollTask<ModbusPoller>;
 
+    struct ScheduleEntry {
+        Time                                    due;
+        PTask                                   task;
+
+        bool                                    operator>(const ScheduleEntry& other) const { return due > other.due; }
+    };
+
+    using Schedule                              = std::priority_queue<ScheduleEntry, std::vector<ScheduleEntry>, std::greater<ScheduleEntry>>;
+
+    struct ReadRange {
+        uint8_t                                 unitId;
+        uint8_t                                 functionCode;
+        uint16_t                                startAddress;
+        uint16_t                                numEntries;
+    };
+
+    struct Transaction {
+        std::vector<PTask>                      tasks;
+        ReadRange                               range;
+        Clock::time_point                       sent;           // only set with metrics
+        std::size_t                             requestSize;
+    };
+
     std::shared_ptr<SocketConnector>            m_connector;
     SocketConnector::Socket                     m_socket;
     bool                                        m_connected;
+    std::size_t                                 m_connectionId;
     std::set<PTask>                             m_tasks;
+    Schedule                                    m_schedule;
+    boost::asio::deadline_timer                 m_scheduleTimer;
+    bool                                        m_scheduling;
     std::list<PTask>                            m_taskQueue;
+    std::map<uint16_t, Transaction>             m_requestsInFlight;
+    std::size_t                                 m_maxRequestsInFlight;
+    bool                                        m_coalescing;
+    bool                                        m_dispatchScheduled;
+    Vector                                      m_coalescedBuffer;
+    uint16_t                                    m_nextTransactionId;
+    Vector                                      m_txPending;
+    Vector                                      m_txBuffer;
+    bool                                        m_sending;
+    Vector                                      m_rxBuffer;
+    std::size_t                                 m_rxBegin;
+    std::size_t                                 m_rxEnd;
+    bool                                        m_receiving;
+
+    // written from the io_service thread only, may be read from any thread
+    std::atomic<uint64_t>                       m_numTransactions;
+    std::atomic<uint64_t>                       m_numResponses;
+    std::atomic<uint64_t>                       m_numSkippedPolls;
+    std::atomic<uint64_t>                       m_numConnectionErrors;
+    std::atomic<double>                         m_pollRate;
+    modbus::Metrics*                            m_metrics;
 
     void                                        initFirstConnection();
     void                                        onFirstTimeConnected();
@@ -36,9 +117,30 @@ private:
     void                                        onReconnected();
 
     boost::asio::io_service&                    get_io_service();
-    void                                        enque(PTask task);
-    void                                        handleModbusDialogDone(const boost::system::error_code& ec);
-    void                                        handleModbusDialogDone();
+
+    void                                        schedule(const PTask& task, const Time& due);
+    void                                        initScheduleTimer();
+    void                                        onScheduleTimer();
+    void                                        enque(const PTask& task);
+
+    void                                        scheduleDispatch();
+    void                                        dispatchRequests();
+    void                                        coalesceRequests(Transaction& transaction);
+    uint16_t                                    allocateTransactionId();
+    void                                        initRequestSending();
+    void                                        onRequestSent(std::size_t connectionId, const boost::system::error_code& ec);
+
+    void                                        initReception();
+    void                                        onDataReceived(std::size_t bytesReceived);
+    void                                        dispatchResponse(const uint8_t* rsp, std::size_t size);
+    void                                        scatterResponse(const Transaction& transaction, const PTask& task, const uint8_t* rsp, std::size_t size);
+
+    static void                                 publishResponse(const Vector& rsp, ModbusRegisterImage& image);
+    static bool                                 getReadRange(const Vector& req, ReadRange& range);
+    static bool                                 isBitRange(const ReadRange& range);
+
+    void                                        handleConnectionError(std::size_t connectionId, const boost::system::error_code& ec);
+    void                                        halt();
 };
 
 
@@ -51,21 +153,87 @@ ModbusPoller::ModbusPoller(boost::asio::io_service& io, const SocketConnector::E
     m_connector(std::make_shared<SocketConnector>(io, ep, reconnectInterval)),
     m_socket(io),
     m_connected(false),
+    m_connectionId(0),
     m_tasks(),
-    m_taskQueue()
+    m_schedule(),
+    m_scheduleTimer(io),
+    m_scheduling(false),
+    m_taskQueue(),
+    m_requestsInFlight(),
+    m_maxRequestsInFlight(1),
+    m_coalescing(true),
+    m_dispatchScheduled(false),
+    m_coalescedBuffer(),
+    m_nextTransactionId(0),
+    m_txPending(),
+    m_txBuffer(),
+    m_sending(false),
+    m_rxBuffer(16 * modbus::tcp::MODBUS_MAX_ADU_LENGTH),
+    m_rxBegin(0),
+    m_rxEnd(0),
+    m_receiving(false),
+    m_numTransactions(0),
+    m_numResponses(0),
+    m_numSkippedPolls(0),
+    m_numConnectionErrors(0),
+    m_pollRate(0),
+    m_metrics(nullptr)
 {
-    std::cout << "ModbusPoller: " << this << std::endl;
+    MODBUS_LOG_DEBUG("ModbusPoller " << this);
 }
 
 
 ModbusPoller::~ModbusPoller() {
-    std::cout << "~ModbusPoller: " << this << std::endl;
+    MODBUS_LOG_DEBUG("~ModbusPoller " << this);
 }
 
 
 void ModbusPoller::addPollTask(const Vector& req, Vector& rsp, const Interval& interval, PollCallback cb) {
-    auto task = std::make_shared<Task>(shared_from_this(), req, rsp, interval, cb);
+    if (interval.total_milliseconds() <= 0)
+        throw std::logic_error("poll interval must be positive");
+
+    auto task = std::make_shared<Task>(req, rsp, interval, cb);
     m_tasks.insert(task);
+
+    m_pollRate.store(m_pollRate.load(std::memory_order_relaxed) + 1000.0 / interval.total_milliseconds(), std::memory_order_relaxed);
+
+    if (m_scheduling)
+        schedule(task, boost::asio::deadline_timer::traits_type::now());
+}
+
+
+std::shared_ptr<ModbusRegisterImage> ModbusPoller::addPollTask(const Vector& req, const Interval& interval) {
+    ReadRange range;
+
+    if (!getReadRange(req, range))
+        throw std::logic_error("only read requests can be polled into a register image");
+
+    auto image = std::make_shared<ModbusRegisterImage>(range.numEntries);
+    auto rsp = std::make_shared<Vector>();
+
+    addPollTask(req, *rsp, interval, [image, rsp]() {
+        publishResponse(*rsp, *image);
+    });
+
+    return image;
+}
+
+
+void ModbusPoller::setMaxRequestsInFlight(std::size_t maxRequestsInFlight) {
+    if (maxRequestsInFlight == 0 || maxRequestsInFlight > 0xFFFF)
+        throw std::logic_error("number of requests in flight must be in range [1, 65535]");
+
+    m_maxRequestsInFlight = maxRequestsInFlight;
+}
+
+
+void ModbusPoller::setRequestCoalescing(bool enabled) {
+    m_coalescing = enabled;
+}
+
+
+void ModbusPoller::setMetrics(modbus::Metrics* metrics) {
+    m_metrics = metrics;
 }
 
 
@@ -76,9 +244,11 @@ void ModbusPoller::start() {
 
 void ModbusPoller::initFirstConnection() {
     auto self = shared_from_this();
+    std::size_t connectionId = m_connectionId;
 
-    m_connector->async_connect(m_socket, [self, this](const boost::system::error_code& ec) {
-        if (ec)
+    m_connector->async_connect(m_socket, [self, this, connectionId](const boost::system::error_code& ec) {
+        // a connection completed just before stop() must not revive the poller
+        if (ec || connectionId != m_connectionId)
             return;
 
         onFirstTimeConnected();
@@ -88,63 +258,464 @@ void ModbusPoller::initFirstConnection() {
 
 void ModbusPoller::onFirstTimeConnected() {
     m_connected = true;
+    m_scheduling = true;
+
+    Time now = boost::asio::deadline_timer::traits_type::now();
 
     for (auto& task: m_tasks)
-        task->start();
+        m_schedule.push(ScheduleEntry{now, task});
+
+    onScheduleTimer();
+}
+
+
+void ModbusPoller::schedule(const PTask& task, const Time& due) {
+    bool earliest = m_schedule.empty() || due < m_schedule.top().due;
+
+    m_schedule.push(ScheduleEntry{due, task});
+
+    if (earliest)
+        initScheduleTimer();
+}
+
+
+void ModbusPoller::initScheduleTimer() {
+    auto self = shared_from_this();
+
+    m_scheduleTimer.expires_at(m_schedule.top().due);
+    m_scheduleTimer.async_wait([self, this](const boost::system::error_code& ec) {
+        if (ec)
+            return;
+
+        onScheduleTimer();
+    });
+}
+
+
+void ModbusPoller::onScheduleTimer() {
+    Time now = boost::asio::deadline_timer::traits_type::now();
+
+    // entries come off the heap earliest deadline first, which is the order they are queued in
+    while (!m_schedule.empty() && m_schedule.top().due <= now) {
+        ScheduleEntry entry = m_schedule.top();
+        m_schedule.pop();
+
+        if (!entry.task->isQueued())
+            enque(entry.task);
+        else
+            m_numSkippedPolls.fetch_add(1, std::memory_order_relaxed);
+
+        // a task that fell behind is not polled back to back to catch up, its phase is reset instead
+        Time next = entry.due + entry.task->getInterval();
+        if (next <= now)
+            next = now + entry.task->getInterval();
+
+        m_schedule.push(ScheduleEntry{next, entry.task});
+    }
+
+    if (!m_schedule.empty())
+        initScheduleTimer();
 }
 
 
-void ModbusPoller::enque(PTask task) {
+void ModbusPoller::enque(const PTask& task) {
     if (!m_connected)
         return;
 
-    if (m_taskQueue.empty()) {
-        m_taskQueue.push_back(task);
-        task->asyncModbusDialog(&m_socket);
+    task->setQueued(true);
+    m_taskQueue.push_back(task);
+    scheduleDispatch();
+}
+
+
+void ModbusPoller::scheduleDispatch() {
+    if (m_dispatchScheduled)
+        return;
+
+    // defer, so that all tasks becoming due in this round get a chance to be coalesced together
+    auto self = shared_from_this();
+    m_dispatchScheduled = true;
+
+    get_io_service().post([self, this]() {
+        m_dispatchScheduled = false;
+
+        if (m_connected)
+            dispatchRequests();
+    });
+}
+
+
+void ModbusPoller::dispatchRequests() {
+    while (!m_taskQueue.empty() && m_requestsInFlight.size() < m_maxRequestsInFlight) {
+        auto task = m_taskQueue.front();
+        m_taskQueue.pop_front();
+
+        uint16_t transactionId = allocateTransactionId();
+        m_numTransactions.fetch_add(1, std::memory_order_relaxed);
+        Transaction& transaction = m_requestsInFlight[transactionId];
+        transaction.tasks.push_back(task);
+        transaction.sent = m_metrics ? Clock::now() : Clock::time_point();
+
+        if (m_coalescing && getReadRange(task->getRequest(), transaction.range))
+            coalesceRequests(transaction);
+
+        if (transaction.tasks.size() == 1) {
+            const Vector& req = task->getRequest(modbus::tcp::TransactionId(transactionId));
+            m_txPending.insert(m_txPending.end(), req.begin(), req.end());
+            transaction.requestSize = req.size();
+            continue;
+        }
+
+        const ReadRange& range = transaction.range;
+        modbus::tcp::Encoder encoder(modbus::tcp::UnitId(range.unitId), modbus::tcp::TransactionId(transactionId));
+        modbus::tcp::Address startAddress(range.startAddress);
+
+        switch (static_cast<modbus::tcp::FunctionCode>(range.functionCode)) {
+            case modbus::tcp::FunctionCode::READ_COILS:
+                encoder.encodeReadCoilsReq(startAddress, modbus::tcp::NumBits(range.numEntries), m_coalescedBuffer);
+                break;
+
+            case modbus::tcp::FunctionCode::READ_DISCRETE_INPUTS:
+                encoder.encodeReadDiscreteInputsReq(startAddress, modbus::tcp::NumBits(range.numEntries), m_coalescedBuffer);
+                break;
+
+            case modbus::tcp::FunctionCode::READ_HOLDING_REGISTERS:
+                encoder.encodeReadHoldingRegistersReq(startAddress, modbus::tcp::NumRegs(range.numEntries), m_coalescedBuffer);
+                break;
+
+            default:
+                encoder.encodeReadInputRegistersReq(startAddress, modbus::tcp::NumRegs(range.numEntries), m_coalescedBuffer);
+                break;
+        }
+
+        m_txPending.insert(m_txPending.end(), m_coalescedBuffer.begin(), m_coalescedBuffer.end());
+        transaction.requestSize = m_coalescedBuffer.size();
+    }
+
+    if (!m_sending && !m_txPending.empty())
+        initRequestSending();
+
+    if (!m_receiving && !m_requestsInFlight.empty())
+        initReception();
+}
+
+
+uint16_t ModbusPoller::allocateTransactionId() {
+    while (m_requestsInFlight.count(m_nextTransactionId) != 0)
+        ++m_nextTransactionId;
+
+    return m_nextTransactionId++;
+}
+
+
+void ModbusPoller::initRequestSending() {
+    auto self = shared_from_this();
+    std::size_t connectionId = m_connectionId;
+
+    m_txBuffer.swap(m_txPending);
+    m_txPending.clear();
+    m_sending = true;
+
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_txBuffer), [self, this, connectionId](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
+        onRequestSent(connectionId, ec);
+    });
+}
+
+
+void ModbusPoller::onRequestSent(std::size_t connectionId, const boost::system::error_code& ec) {
+    if (connectionId != m_connectionId)
+        return;
+
+    m_sending = false;
+
+    if (ec) {
+        handleConnectionError(connectionId, ec);
+        return;
+    }
+
+    if (!m_txPending.empty())
+        initRequestSending();
+}
+
+
+void ModbusPoller::initReception() {
+    if (m_rxBuffer.size() - m_rxEnd < modbus::tcp::MODBUS_MAX_ADU_LENGTH) {
+        std::memmove(m_rxBuffer.data(), m_rxBuffer.data() + m_rxBegin, m_rxEnd - m_rxBegin);
+        m_rxEnd -= m_rxBegin;
+        m_rxBegin = 0;
+    }
+
+    auto self = shared_from_this();
+    std::size_t connectionId = m_connectionId;
+    m_receiving = true;
+
+    m_socket.async_read_some(boost::asio::buffer(m_rxBuffer.data() + m_rxEnd, m_rxBuffer.size() - m_rxEnd), [self, this, connectionId](const boost::system::error_code& ec, std::size_t bytesReceived) {
+        if (connectionId != m_connectionId)
+            return;
+
+        m_receiving = false;
+
+        if (ec)
+            handleConnectionError(connectionId, ec);
+        else
+            onDataReceived(bytesReceived);
+    });
+}
+
+
+void ModbusPoller::onDataReceived(std::size_t bytesReceived) {
+    m_rxEnd += bytesReceived;
+
+    while (m_rxEnd - m_rxBegin >= sizeof(modbus::tcp::Header)) {
+        const uint8_t* rsp = m_rxBuffer.data() + m_rxBegin;
+        std::size_t length = ntohs(reinterpret_cast<const modbus::tcp::Header*>(rsp)->length);
+
+        if (modbus::tcp::validateHeader(rsp, m_rxEnd - m_rxBegin) != modbus::tcp::FrameError::OK) {
+            handleConnectionError(m_connectionId, boost::asio::error::invalid_argument);
+            return;
+        }
+
+        if (m_rxEnd - m_rxBegin < length + 6)
+            break;
+
+        m_rxBegin += length + 6;
+        dispatchResponse(rsp, length + 6);
+    }
+
+    if (m_rxBegin == m_rxEnd) {
+        m_rxBegin = 0;
+        m_rxEnd = 0;
+    }
+
+    dispatchRequests();
+
+    if (!m_receiving && m_rxEnd != m_rxBegin)
+        initReception();
+}
+
+
+void ModbusPoller::dispatchResponse(const uint8_t* rsp, std::size_t size) {
+    uint16_t transactionId = ntohs(reinterpret_cast<const modbus::tcp::Header*>(rsp)->transactionId);
+    auto it = m_requestsInFlight.find(transactionId);
+
+    if (it == m_requestsInFlight.end())
+        return;
+
+    Transaction transaction = std::move(it->second);
+    m_requestsInFlight.erase(it);
+    m_numResponses.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_metrics) {
+        const uint8_t functionCode = reinterpret_cast<const modbus::tcp::Header*>(rsp)->functionCode;
+
+        m_metrics->recordPolled(functionCode, size, transaction.requestSize, (functionCode & 0x80) != 0,
+                                std::chrono::duration_cast<modbus::Metrics::Duration>(Clock::now() - transaction.sent));
+    }
+
+    for (auto& task: transaction.tasks)
+        task->setQueued(false);
+
+    if (transaction.tasks.size() == 1) {
+        transaction.tasks.front()->onResponse(rsp, size);
+        return;
+    }
+
+    for (auto& task: transaction.tasks)
+        scatterResponse(transaction, task, rsp, size);
+}
+
+
+void ModbusPoller::coalesceRequests(Transaction& transaction) {
+    ReadRange& merged = transaction.range;
+    const std::size_t maxEntries = isBitRange(merged) ? modbus::tcp::MODBUS_MAX_NUM_BITS_IN_READ_REQUEST : modbus::tcp::MODBUS_MAX_NUM_REGS_IN_READ_REQUEST;
+
+    std::size_t begin = merged.startAddress;
+    std::size_t end = begin + merged.numEntries;
+    bool grown = true;
+
+    // a grown range may become adjacent to tasks already skipped, so rescan until nothing else fits
+    while (grown) {
+        grown = false;
+
+        for (auto it = m_taskQueue.begin(); it != m_taskQueue.end(); ) {
+            ReadRange range;
+
+            if (getReadRange((*it)->getRequest(), range) && range.unitId == merged.unitId && range.functionCode == merged.functionCode) {
+                std::size_t rangeBegin = range.startAddress;
+                std::size_t rangeEnd = rangeBegin + range.numEntries;
+                std::size_t mergedBegin = std::min(begin, rangeBegin);
+                std::size_t mergedEnd = std::max(end, rangeEnd);
+
+                if (rangeBegin <= end && rangeEnd >= begin && mergedEnd - mergedBegin <= maxEntries) {
+                    begin = mergedBegin;
+                    end = mergedEnd;
+                    transaction.tasks.push_back(*it);
+                    it = m_taskQueue.erase(it);
+                    grown = true;
+                    continue;
+                }
+            }
+
+            ++it;
+        }
+    }
+
+    merged.startAddress = begin;
+    merged.numEntries = end - begin;
+}
+
+
+void ModbusPoller::scatterResponse(const Transaction& transaction, const PTask& task, const uint8_t* rsp, std::size_t size) {
+    const auto* header = reinterpret_cast<const modbus::tcp::Header*>(rsp);
+
+    if (header->functionCode & 0x80) {
+        task->onResponse(rsp, size);
+        return;
+    }
+
+    ReadRange range;
+    getReadRange(task->getRequest(), range);
+
+    const bool bits = isBitRange(range);
+    const std::size_t offset = range.startAddress - transaction.range.startAddress;
+    const std::size_t numBytes = bits ? (range.numEntries + 7) / 8 : 2 * range.numEntries;
+    const std::size_t numBytesNeeded = bits ? (offset + range.numEntries + 7) / 8 : 2 * (offset + range.numEntries);
+
+    if (size < sizeof(modbus::tcp::ReadCoilsRsp) || size - sizeof(modbus::tcp::ReadCoilsRsp) < numBytesNeeded)
+        return;
+
+    const uint8_t* src = rsp + sizeof(modbus::tcp::ReadCoilsRsp);
+
+    m_coalescedBuffer.assign(sizeof(modbus::tcp::ReadCoilsRsp) + numBytes, 0);
+    auto* msg = reinterpret_cast<modbus::tcp::ReadCoilsRsp*>(m_coalescedBuffer.data());
+
+    msg->header = *header;
+    msg->header.length = htons(3 + numBytes);
+    msg->numBytes = numBytes;
+
+    if (bits) {
+        for (std::size_t i = 0; i < range.numEntries; ++i) {
+            std::size_t pos = offset + i;
+
+            if (src[pos / 8] & (1 << (pos % 8)))
+                msg->coils[i / 8] |= (1 << (i % 8));
+        }
     } else
-        m_taskQueue.push_back(task);
+        std::memcpy(msg->coils, src + 2 * offset, numBytes);
+
+    task->onResponse(m_coalescedBuffer.data(), m_coalescedBuffer.size());
 }
 
 
-void ModbusPoller::handleModbusDialogDone(const boost::system::error_code& ec) {
-    m_taskQueue.pop_front();
+void ModbusPoller::publishResponse(const Vector& rsp, ModbusRegisterImage& image) {
+    if (rsp.size() < sizeof(modbus::tcp::ReadCoilsRsp))
+        return;
+
+    const auto* msg = reinterpret_cast<const modbus::tcp::ReadCoilsRsp*>(rsp.data());
+    const std::size_t numBytes = rsp.size() - sizeof(modbus::tcp::ReadCoilsRsp);
+    const bool bits = msg->header.functionCode == static_cast<uint8_t>(modbus::tcp::FunctionCode::READ_COILS) ||
+                      msg->header.functionCode == static_cast<uint8_t>(modbus::tcp::FunctionCode::READ_DISCRETE_INPUTS);
+
+    // exception responses leave the last good snapshot in place
+    if ((msg->header.functionCode & 0x80) || msg->numBytes != numBytes)
+        return;
 
-    if (ec == boost::asio::error::operation_aborted) {
+    if (numBytes < (bits ? (image.size() + 7) / 8 : 2 * image.size()))
         return;
-    } else {
-        m_connected = false;
-        m_taskQueue.clear();
-        initReconnection();
+
+    image.beginUpdate();
+
+    for (std::size_t i = 0; i < image.size(); ++i) {
+        if (bits)
+            image.set(i, (msg->coils[i / 8] >> (i % 8)) & 1);
+        else
+            image.set(i, (msg->coils[2 * i] << 8) | msg->coils[2 * i + 1]);
     }
+
+    image.endUpdate();
+}
+
+
+bool ModbusPoller::getReadRange(const Vector& req, ReadRange& range) {
+    if (req.size() != sizeof(modbus::tcp::ReadReq))
+        return false;
+
+    const auto* msg = reinterpret_cast<const modbus::tcp::ReadReq*>(req.data());
+
+    switch (static_cast<modbus::tcp::FunctionCode>(msg->header.functionCode)) {
+        case modbus::tcp::FunctionCode::READ_COILS:
+        case modbus::tcp::FunctionCode::READ_DISCRETE_INPUTS:
+        case modbus::tcp::FunctionCode::READ_HOLDING_REGISTERS:
+        case modbus::tcp::FunctionCode::READ_INPUT_REGISTERS:
+            range.unitId = msg->header.unitId;
+            range.functionCode = msg->header.functionCode;
+            range.startAddress = ntohs(msg->startAddress);
+            range.numEntries = ntohs(msg->numEntries);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+bool ModbusPoller::isBitRange(const ReadRange& range) {
+    return range.functionCode == static_cast<uint8_t>(modbus::tcp::FunctionCode::READ_COILS) ||
+           range.functionCode == static_cast<uint8_t>(modbus::tcp::FunctionCode::READ_DISCRETE_INPUTS);
+}
+
+
+void ModbusPoller::handleConnectionError(std::size_t connectionId, const boost::system::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted || connectionId != m_connectionId)
+        return;
+
+    ++m_connectionId;
+    m_numConnectionErrors.fetch_add(1, std::memory_order_relaxed);
+    m_connected = false;
+    m_sending = false;
+    m_receiving = false;
+    m_rxBegin = 0;
+    m_rxEnd = 0;
+    m_txPending.clear();
+    m_taskQueue.clear();
+    m_requestsInFlight.clear();
+
+    for (auto& task: m_tasks)
+        task->setQueued(false);
+
+    boost::system::error_code ignored;
+    m_socket.close(ignored);
+
+    initReconnection();
 }
 
 
 void ModbusPoller::initReconnection() {
     auto self = shared_from_this();
+    std::size_t connectionId = m_connectionId;
 
-    m_connector->async_connect(m_socket, [self, this](const boost::system::error_code& ec) {
-        if (ec)
+    m_connector->async_connect(m_socket, [self, this, connectionId](const boost::system::error_code& ec) {
+        if (ec || connectionId != m_connectionId)
             return;
 
         onReconnected();
     });
-   
+
 }
 
 
 void ModbusPoller::onReconnected() {
     m_connected = true;
-
-    if (!m_taskQueue.empty())
-        m_taskQueue.front()->asyncModbusDialog(&m_socket);
+    dispatchRequests();
 }
 
 
-void ModbusPoller::handleModbusDialogDone() {
-    m_taskQueue.pop_front();
+void ModbusPoller::stop() {
+    auto self = shared_from_this();
 
-    if (!m_taskQueue.empty())
-        m_taskQueue.front()->asyncModbusDialog(&m_socket);
+    m_socket.get_io_service().post([self, this] {
+        halt();
+    });
 }
 
 
@@ -152,24 +723,53 @@ void ModbusPoller::cancel() {
     auto self = shared_from_this();
 
     m_socket.get_io_service().post([self, this] {
-        m_connector->cancel();
+        halt();
+        m_tasks.clear();
+    });
+}
 
-        for (auto&task: m_tasks)
-            task->cancel();
 
-        m_socket.cancel();
-        m_connected = false;
+void ModbusPoller::halt() {
+    m_connector->cancel();
 
-        m_tasks.clear();
+    m_scheduling = false;
+    m_scheduleTimer.cancel();
+    m_schedule = Schedule();
 
-        if (!m_taskQueue.empty()) {
-            auto front = m_taskQueue.front();
-            m_taskQueue.clear();
-            m_taskQueue.push_back(front);
-        } else
-            m_taskQueue.clear();
-    });
+    ++m_connectionId;
+    m_connected = false;
+    m_sending = false;
+    m_receiving = false;
+    m_rxBegin = 0;
+    m_rxEnd = 0;
+
+    m_taskQueue.clear();
+    m_requestsInFlight.clear();
+    m_txPending.clear();
+
+    for (auto& task: m_tasks)
+        task->setQueued(false);
+
+    // closed rather than cancelled, so that a later start() can connect it again
+    boost::system::error_code ignored;
+    m_socket.close(ignored);
 }
 
-#endif
 
+ModbusPoller::Stats ModbusPoller::getStats() const {
+    Stats stats;
+
+    stats.numTransactions = m_numTransactions.load(std::memory_order_relaxed);
+    stats.numResponses = m_numResponses.load(std::memory_order_relaxed);
+    stats.numSkippedPolls = m_numSkippedPolls.load(std::memory_order_relaxed);
+    stats.numConnectionErrors = m_numConnectionErrors.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+
+double ModbusPoller::getPollRate() const {
+    return m_pollRate.load(std::memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef MODBUS_POLLER_POOL_HPP
+#define MODBUS_POLLER_POOL_HPP
+
+
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+
+// Shards pollers across a set of io_services, each one run by a single thread. A poller never
+// leaves the io_service it was created on, so all its handlers run on one thread and need no locks.
+//
+// Placement is static: a poller goes to the least loaded shard at the time it is added and is never
+// rebalanced afterwards. Load is the configured poll rate until the pool has run for a second and the
+// measured transaction rate after that; with request coalescing the configured rate overstates the
+// real cost, so pollers that are added in bulk before start() may end up unevenly spread.
+class ModbusPollerPool {
+public:
+    using Interval                              = boost::posix_time::milliseconds;
+    using PModbusPoller                         = std::shared_ptr<ModbusPoller>;
+
+    struct Stats {
+        std::size_t                             numPollers;
+        ModbusPoller::Stats                     totals;
+        std::vector<std::size_t>                pollersPerThread;
+        std::vector<double>                     loadPerThread;      // transactions per second
+    };
+
+    inline explicit                             ModbusPollerPool(std::size_t numThreads);
+    inline                                     ~ModbusPollerPool();
+
+    // poll tasks must be added to the returned poller before it is started by start()
+    inline PModbusPoller                        addPoller(const SocketConnector::Endpoint& ep, const Interval& reconnectInterval);
+
+    // start() after stop() restarts every poller of the pool, with the poll tasks it had
+    inline void                                 start();
+    inline void                                 stop();
+
+    inline Stats                                getStats() const;
+
+private:
+    using Clock                                 = std::chrono::steady_clock;
+
+    struct Shard {
+        boost::asio::io_service                 io;
+        std::unique_ptr<boost::asio::io_service::work> work;
+        std::thread                             thread;
+        std::vector<PModbusPoller>              pollers;
+        std::size_t                             numStarted;
+    };
+
+    std::vector<std::unique_ptr<Shard>>         m_shards;
+    mutable std::mutex                          m_mutex;
+    bool                                        m_running;
+    Clock::time_point                           m_startTime;
+
+    inline double                               getLoad(const Shard& shard) const;
+    inline double                               getLoad(const ModbusPoller& poller) const;
+};
+
+
+ModbusPollerPool::ModbusPollerPool(std::size_t numThreads) :
+    m_shards(),
+    m_mutex(),
+    m_running(false),
+    m_startTime(Clock::now())
+{
+    if (numThreads == 0)
+        throw std::logic_error("poller pool needs at least one thread");
+
+    for (std::size_t i = 0; i < numThreads; ++i) {
+        m_shards.emplace_back(new Shard());
+        m_shards.back()->numStarted = 0;
+    }
+}
+
+
+ModbusPollerPool::~ModbusPollerPool() {
+    stop();
+}
+
+
+ModbusPollerPool::PModbusPoller ModbusPollerPool::addPoller(const SocketConnector::Endpoint& ep, const Interval& reconnectInterval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Shard* target = m_shards.front().get();
+    double targetLoad = getLoad(*target);
+
+    for (auto& shard: m_shards) {
+        double load = getLoad(*shard);
+
+        if (load < targetLoad || (load == targetLoad && shard->pollers.size() < target->pollers.size())) {
+            target = shard.get();
+            targetLoad = load;
+        }
+    }
+
+    auto poller = std::make_shared<ModbusPoller>(target->io, ep, reconnectInterval);
+    target->pollers.push_back(poller);
+
+    return poller;
+}
+
+
+void ModbusPollerPool::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_running) {
+        m_running = true;
+        m_startTime = Clock::now();
+
+        for (auto& shard: m_shards) {
+            Shard* s = shard.get();
+
+            s->io.reset();
+            s->work.reset(new boost::asio::io_service::work(s->io));
+            s->thread = std::thread([s]() { s->io.run(); });
+        }
+    }
+
+    // pollers added since the last call are started now, on their own thread
+    for (auto& shard: m_shards) {
+        for (; shard->numStarted < shard->pollers.size(); ++shard->numStarted) {
+            PModbusPoller poller = shard->pollers[shard->numStarted];
+            shard->io.post([poller]() { poller->start(); });
+        }
+    }
+}
+
+
+void ModbusPollerPool::stop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_running)
+        return;
+
+    m_running = false;
+
+    for (auto& shard: m_shards) {
+        for (auto& poller: shard->pollers)
+            poller->stop();
+
+        shard->numStarted = 0;
+        shard->work.reset();
+    }
+
+    lock.unlock();
+
+    for (auto& shard: m_shards)
+        shard->thread.join();
+}
+
+
+ModbusPollerPool::Stats ModbusPollerPool::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = Stats();
+
+    for (auto& shard: m_shards) {
+        stats.numPollers += shard->pollers.size();
+        stats.pollersPerThread.push_back(shard->pollers.size());
+        stats.loadPerThread.push_back(getLoad(*shard));
+
+        for (auto& poller: shard->pollers) {
+            ModbusPoller::Stats pollerStats = poller->getStats();
+
+            stats.totals.numTransactions += pollerStats.numTransactions;
+            stats.totals.numResponses += pollerStats.numResponses;
+            stats.totals.numSkippedPolls += pollerStats.numSkippedPolls;
+            stats.totals.numConnectionErrors += pollerStats.numConnectionErrors;
+        }
+    }
+
+    return stats;
+}
+
+
+double ModbusPollerPool::getLoad(const Shard& shard) const {
+    double load = 0;
+
+    for (auto& poller: shard.pollers)
+        load += getLoad(*poller);
+
+    return load;
+}
+
+
+double ModbusPollerPool::getLoad(const ModbusPoller& poller) const {
+    // the configured poll rate until the poller has a track record, the measured rate afterwards
+    double load = poller.getPollRate();
+
+    if (m_running) {
+        double elapsed = std::chrono::duration<double>(Clock::now() - m_startTime).count();
+
+        if (elapsed > 1.0)
+            load = std::max(load, poller.getStats().numTransactions / elapsed);
+    }
+
+    return load;
+}
+
+#endif
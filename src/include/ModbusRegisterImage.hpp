@@ -0,0 +1,108 @@
+#ifndef MODBUS_REGISTER_IMAGE_HPP
+#define MODBUS_REGISTER_IMAGE_HPP
+
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Snapshot of a polled range, written by the io_service thread and read from any thread.
+// Guarded by a sequence lock: writers never wait, readers never block the writer and only
+// retry if they overlapped with an update.
+class ModbusRegisterImage {
+public:
+    using Vector                                = std::vector<uint16_t>;
+
+    inline explicit                             ModbusRegisterImage(std::size_t numValues);
+
+    inline std::size_t                          size() const;
+    inline uint64_t                             getVersion() const;
+
+    inline uint64_t                             read(uint16_t* values) const;
+    inline uint64_t                             read(Vector& values) const;
+
+    inline void                                 publish(const uint16_t* values);
+    inline void                                 beginUpdate();
+    inline void                                 set(std::size_t idx, uint16_t value);
+    inline void                                 endUpdate();
+
+private:
+    std::size_t                                 m_size;
+    std::unique_ptr<std::atomic<uint16_t>[]>    m_values;
+    std::atomic<uint64_t>                       m_sequence;
+};
+
+
+ModbusRegisterImage::ModbusRegisterImage(std::size_t numValues) :
+    m_size(numValues),
+    m_values(new std::atomic<uint16_t>[numValues]),
+    m_sequence(0)
+{
+    for (std::size_t i = 0; i < m_size; ++i)
+        m_values[i].store(0, std::memory_order_relaxed);
+}
+
+
+std::size_t ModbusRegisterImage::size() const {
+    return m_size;
+}
+
+
+uint64_t ModbusRegisterImage::getVersion() const {
+    return m_sequence.load(std::memory_order_acquire) / 2;
+}
+
+
+uint64_t ModbusRegisterImage::read(uint16_t* values) const {
+    uint64_t before;
+    uint64_t after;
+
+    do {
+        before = m_sequence.load(std::memory_order_acquire);
+
+        for (std::size_t i = 0; i < m_size; ++i)
+            values[i] = m_values[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    return before / 2;
+}
+
+
+uint64_t ModbusRegisterImage::read(Vector& values) const {
+    values.resize(m_size);
+    return read(values.data());
+}
+
+
+void ModbusRegisterImage::publish(const uint16_t* values) {
+    beginUpdate();
+
+    for (std::size_t i = 0; i < m_size; ++i)
+        set(i, values[i]);
+
+    endUpdate();
+}
+
+
+void ModbusRegisterImage::beginUpdate() {
+    m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+void ModbusRegisterImage::set(std::size_t idx, uint16_t value) {
+    m_values[idx].store(value, std::memory_order_relaxed);
+}
+
+
+void ModbusRegisterImage::endUpdate() {
+    m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+#endif
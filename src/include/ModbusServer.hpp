@@ -3,8 +3,10 @@
 
 #include "ModbusServerSession.hpp"
 
-#include <set>
+#include <algorithm>
+#include <map>
 #include <stdexcept>
+#include <vector>
 
 
 namespace modbus {
@@ -12,22 +14,60 @@ namespace tcp {
 
 class Server {
 public:
+    // Admission and rate limits, zero meaning unlimited. Connections beyond maxSessions in total or
+    // maxSessionsPerClient from one address are closed right after being accepted.
+    struct Limits {
+                                    Limits() : maxSessions(0), maxSessionsPerClient(0), maxRequestRate(0), requestBurst(0),
+                                               idleTimeout(0), frameTimeout(0) {}
+
+        std::size_t                 maxSessions;
+        std::size_t                 maxSessionsPerClient;
+        double                      maxRequestRate;     // requests per second and session
+        double                      requestBurst;
+        TimingWheel::Interval       idleTimeout;        // without a request
+        TimingWheel::Interval       frameTimeout;       // for the rest of a started frame to arrive
+    };
+
                                     Server(boost::asio::io_service& io, ServerDevice& device);
 
     void                            start(const boost::asio::ip::tcp::endpoint& ep, std::function<void(void)> done_cb);
     void                            stop();
 
+    // Open and bind the acceptor right away, on the calling thread, so that a failure is thrown to
+    // the caller instead of out of io_service::run(). A following start() uses the bound acceptor.
+    void                            listen(const boost::asio::ip::tcp::endpoint& ep);
+
+    // Close an acceptor bound by listen() that was never started.
+    void                            close();
+
+    // Bind with SO_REUSEPORT, so several servers can listen on the same endpoint and have the
+    // kernel balance incoming connections between them. Must be called before start().
+    void                            setReusePort(bool reusePort);
+
+    // Must be called before start().
+    void                            setLimits(const Limits& limits);
+
+    // Record into metrics, which must outlive the server. Must be called before start().
+    void                            setMetrics(Metrics* metrics);
+
 private:
     using PModbusSession = std::shared_ptr<ServerSession>;
 
     ServerDevice                   &m_device;
     boost::asio::ip::tcp::acceptor  m_acceptor;
-    std::set<PModbusSession>        m_sessions;
+    TimingWheel                     m_timeouts;         // shared by all sessions, outlives them
+    std::vector<PModbusSession>     m_sessions;
+    std::vector<PModbusSession>     m_idle_sessions;    // finished sessions, reused for new connections
     std::function<void(void)>       m_done_cb;
+    bool                            m_reusePort;
+    Limits                          m_limits;
+    Metrics*                        m_metrics;
+    std::map<boost::asio::ip::address, std::size_t> m_sessions_per_client;
 
     void                            init_accepting();
     void                            on_client_connected(PModbusSession session, const boost::system::error_code& ec);
-    void                            on_session_done(PModbusSession session);
+    void                            on_session_done(ServerSession* session);
+    bool                            admit(const boost::asio::ip::address& client);
 
     void                            trigger_done_cb();
     void                            init_shutdown_sessions();
@@ -37,25 +77,78 @@ private:
 Server::Server(boost::asio::io_service& io, ServerDevice& device) :
     m_device(device),
     m_acceptor(io),
-    m_sessions()
+    m_timeouts(io, TimingWheel::Interval(100), 1024),
+    m_sessions(),
+    m_idle_sessions(),
+    m_reusePort(false),
+    m_limits(),
+    m_metrics(nullptr),
+    m_sessions_per_client()
 {}
 
 
+void Server::setReusePort(bool reusePort) {
+#ifndef SO_REUSEPORT
+    if (reusePort)
+        throw std::logic_error("SO_REUSEPORT not supported on this platform");
+#endif
+    m_reusePort = reusePort;
+}
+
+
+void Server::setLimits(const Limits& limits) {
+    m_limits = limits;
+}
+
+
+void Server::setMetrics(Metrics* metrics) {
+    m_metrics = metrics;
+}
+
+
 void Server::start(const boost::asio::ip::tcp::endpoint& ep, std::function<void(void)> cb) {
     m_acceptor.get_io_service().post([this, ep, cb]() {
+        if (!m_acceptor.is_open())
+            listen(ep);
+
+        m_done_cb = cb;
+        init_accepting();
+    });
+}
+
+
+void Server::listen(const boost::asio::ip::tcp::endpoint& ep) {
+    try {
         m_acceptor.open(ep.protocol());
         m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (m_reusePort)
+            m_acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
         m_acceptor.bind(ep);
         m_acceptor.listen();
+    } catch (...) {
+        close();
+        throw;
+    }
+}
 
-        m_done_cb = cb;
-        init_accepting();
-    });
+
+void Server::close() {
+    boost::system::error_code ignored;
+    m_acceptor.close(ignored);
 }
 
 
 void Server::init_accepting() {
-    PModbusSession session = std::make_shared<ServerSession>(m_acceptor.get_io_service(), m_device);
+    PModbusSession session;
+
+    if (m_idle_sessions.empty()) {
+        session = std::make_shared<ServerSession>(m_acceptor.get_io_service(), m_device);
+    } else {
+        session = m_idle_sessions.back();
+        m_idle_sessions.pop_back();
+    }
 
     m_acceptor.async_accept(
         session->socket(),
@@ -67,15 +160,32 @@ void Server::init_accepting() {
 
 void Server::on_client_connected(PModbusSession session, const boost::system::error_code& ec) {
     if (ec == boost::asio::error::operation_aborted) {
+        m_idle_sessions.push_back(session);
+
         if (m_sessions.empty())
             trigger_done_cb();
         else
             init_shutdown_sessions();
     } else {
-        m_sessions.insert(session);
-        session->start([this, session]() {
-            m_acceptor.get_io_service().post([this, session]() {
-                on_session_done(session);
+        boost::system::error_code ignored;
+
+        if (!admit(session->socket().remote_endpoint(ignored).address())) {
+            session->socket().close(ignored);
+            m_idle_sessions.push_back(session);
+            init_accepting();
+            return;
+        }
+
+        // the session is owned by m_sessions, a raw pointer keeps the callback free of allocations
+        ServerSession* raw = session.get();
+
+        m_sessions.push_back(session);
+        session->setRequestRate(m_limits.maxRequestRate, m_limits.requestBurst);
+        session->setTimeouts(&m_timeouts, m_limits.idleTimeout, m_limits.frameTimeout);
+        session->setMetrics(m_metrics);
+        session->start([this, raw]() {
+            m_acceptor.get_io_service().post([this, raw]() {
+                on_session_done(raw);
             });
         });
         init_accepting();
@@ -83,15 +193,46 @@ void Server::on_client_connected(PModbusSession session, const boost::system::er
 }
 
 
-void Server::on_session_done(PModbusSession session) {
-    m_sessions.erase(session);
-    std::cout << "session done " << session.get() << std::endl;
+void Server::on_session_done(ServerSession* session) {
+    auto it = std::find_if(m_sessions.begin(), m_sessions.end(), [session](const PModbusSession& s) {
+        return s.get() == session;
+    });
+
+    m_idle_sessions.push_back(*it);
+    *it = m_sessions.back();
+    m_sessions.pop_back();
+
+    if (m_limits.maxSessionsPerClient != 0) {
+        auto client = m_sessions_per_client.find(session->getClientAddress());
+
+        if (client != m_sessions_per_client.end() && --client->second == 0)
+            m_sessions_per_client.erase(client);
+    }
+
+    MODBUS_LOG_DEBUG("session done " << session);
 
     if ((!m_acceptor.is_open()) && m_sessions.empty())
         trigger_done_cb();
 }
 
 
+bool Server::admit(const boost::asio::ip::address& client) {
+    if (m_limits.maxSessions != 0 && m_sessions.size() >= m_limits.maxSessions)
+        return false;
+
+    if (m_limits.maxSessionsPerClient != 0) {
+        std::size_t& numSessions = m_sessions_per_client[client];
+
+        if (numSessions >= m_limits.maxSessionsPerClient)
+            return false;
+
+        ++numSessions;
+    }
+
+    return true;
+}
+
+
 void Server::stop() {
     m_acceptor.get_io_service().post([this]() {
         m_acceptor.close();
@@ -100,9 +241,12 @@ void Server::stop() {
 
 
 void Server::trigger_done_cb() {
+    // the last session and the aborted accept may both report the shutdown
     m_acceptor.get_io_service().post([this]() {
-        m_done_cb();
-        m_done_cb = nullptr;
+        if (m_done_cb) {
+            m_done_cb();
+            m_done_cb = nullptr;
+        }
     });
 }
 
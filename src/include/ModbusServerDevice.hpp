@@ -1,6 +1,10 @@
 #ifndef MODBUS_SERVER_DEVICE_HPP
 #define MODBUS_SERVER_DEVICE_HPP
 
+#include "ModbusEncoder.hpp"
+#include "ModbusDecoder.hpp"
+#include "ModbusFrameValidator.hpp"
+
 namespace modbus {
 namespace tcp {
 
@@ -21,14 +25,64 @@ struct FailedToReadInputs : public error { // exception code 4
 };
 
 
+// Result of a device access. Everything but OK is answered with the exception code of the same value.
+enum class Status : uint8_t {
+    OK = 0x00,
+    ILLEGAL_FUNCTION = static_cast<uint8_t>(ExceptionCode::ILLEGAL_FUNCTION),
+    ILLEGAL_DATA_ADDRESS = static_cast<uint8_t>(ExceptionCode::ILLEGAL_DATA_ADDRESS),
+    ILLEGAL_DATA_VALUE = static_cast<uint8_t>(ExceptionCode::ILLEGAL_DATA_VALUE),
+    SLAVE_DEVICE_FAILURE = static_cast<uint8_t>(ExceptionCode::SLAVE_DEVICE_FAILURE),
+    SLAVE_DEVICE_BUSY = static_cast<uint8_t>(ExceptionCode::SLAVE_DEVICE_BUSY),
+    GATEWAY_PATH_UNAVAILABLE = static_cast<uint8_t>(ExceptionCode::GATEWAY_PATH_UNAVAILABLE),
+    GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND = static_cast<uint8_t>(ExceptionCode::GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND)
+};
+
+
 class ServerDevice {
 public:
                             ServerDevice(const UnitId& unitId);
     virtual                ~ServerDevice();
 
-    void                    handleMessage(const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    virtual void            handleMessage(const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+
+    const UnitId&           getUnitId() const;
 
 protected:
+    // Status based device interface. Override these to report errors without throwing.
+    // The default implementations forward to the exception based virtuals below; where those are not
+    // overridden either, they answer ILLEGAL_FUNCTION without an exception being thrown.
+    virtual Status          readCoil(const Address& address, bool& value) const;
+    virtual Status          readDiscreteInput(const Address& address, bool& value) const;
+    virtual Status          readHoldingRegister(const Address& address, uint16_t& value) const;
+    virtual Status          readInputRegister(const Address& address, uint16_t& value) const;
+
+    virtual Status          writeCoil(const Address& address, bool value);
+    virtual Status          writeRegister(const Address& address, uint16_t value);
+
+    virtual Status          writeCoils(const Address& startAddress, const std::vector<bool>& coils);
+    virtual Status          writeRegisters(const Address& startAddress, const std::vector<uint16_t>& regs);
+
+    // Range reads, one byte per coil / input and registers in host order. Devices backed by arrays
+    // override these to answer a whole request at once. The defaults call the single value reads above.
+    virtual Status          readCoils(const Address& startAddress, std::size_t count, uint8_t* values) const;
+    virtual Status          readDiscreteInputs(const Address& startAddress, std::size_t count, uint8_t* values) const;
+    virtual Status          readHoldingRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const;
+    virtual Status          readInputRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const;
+
+    // Range reads straight into the response payload: coils packed as on the wire, registers big endian.
+    // The defaults convert the result of the range reads above.
+    virtual Status          readCoilsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const;
+    virtual Status          readDiscreteInputsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const;
+    virtual Status          readHoldingRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const;
+    virtual Status          readInputRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const;
+
+    // Range writes straight from the request payload: coils packed as on the wire, registers big
+    // endian. The defaults convert them for writeCoils() and writeRegisters() above.
+    virtual Status          writeCoilsPacked(const Address& startAddress, std::size_t count, const uint8_t* packed);
+    virtual Status          writeRegistersWire(const Address& startAddress, std::size_t count, const uint8_t* wire);
+
+    // Exception based device interface, kept for existing devices. The base versions throw
+    // FunctionCodeNotSupported, except when called from the status defaults above.
     virtual bool            getCoil(const Address& address) const;
     virtual bool            getDiscreteInput(const Address& address) const;
     virtual uint16_t        getHoldingRegister(const Address& addr) const;
@@ -41,16 +95,33 @@ protected:
     virtual void            setRegisters(const Address& startAddress, const std::vector<uint16_t>& regs);
 
 private:
-    inline void             buildResponse                   (const TransactionId& transactionId, std::vector<uint8_t>& tx_buffer, std::function<void(void)> handler);
+    // A call from a status default into the exception based interface, on the current thread
+    struct LegacyCall {
+        bool                unsupported;
+    };
+
+    inline static LegacyCall*& currentLegacyCall();
+
+    template <typename Handler>
+    static Status           callLegacy(Handler handler);
+
+    template <typename T>
+    static T                unsupported(FunctionCode code);
+
+    using RequestHandler    = Status (ServerDevice::*)(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+
+    inline static RequestHandler getHandler(uint8_t functionCode);
 
-    inline void             handleReadCoilsReq              (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const;
-    inline void             handleReadDiscreteInputsReq     (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const;
-    inline void             handleReadHoldingRegistersReq   (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const;
-    inline void             handleReadInputRegistersReq     (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const;
-    inline void             handleWriteSingleCoilReq        (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
-    inline void             handleWriteSingleRegisterReq    (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
-    inline void             handleWriteCoilsReq             (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
-    inline void             handleWriteRegistersReq         (const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleReadCoilsReq              (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleReadDiscreteInputsReq     (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleReadHoldingRegistersReq   (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleReadInputRegistersReq     (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleWriteSingleCoilReq        (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleWriteSingleRegisterReq    (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleWriteCoilsReq             (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+    inline Status           handleWriteRegistersReq         (const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer);
+
+    inline static bool      isAddressRangeValid(std::size_t start, std::size_t count);
 
     UnitId                  m_unitId;
 };
@@ -64,239 +135,453 @@ ServerDevice::~ServerDevice() {
 }
 
 
+const UnitId& ServerDevice::getUnitId() const {
+    return m_unitId;
+}
+
+
 void ServerDevice::handleMessage(const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+    const FrameError error = validateRequest(rx_buffer);
+
+    // a frame that cannot be delimited gets no response, the caller drops the connection
+    if (isFramingError(error)) {
+        tx_buffer.clear();
+        return;
+    }
+
     modbus::tcp::decoder_views::Header header(rx_buffer);
 
     if ((m_unitId.get() != 0) && (header.getUnitId() != m_unitId))
         throw UnitIdMismatch(m_unitId, header.getUnitId());
 
-    switch (header.getFunctionCode()) {
-        case FunctionCode::READ_COILS:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleReadCoilsReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::READ_DISCRETE_INPUTS:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleReadDiscreteInputsReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::READ_HOLDING_REGISTERS:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleReadHoldingRegistersReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::READ_INPUT_REGISTERS:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleReadInputRegistersReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::WRITE_COIL:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleWriteSingleCoilReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::WRITE_REGISTER:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleWriteSingleRegisterReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::WRITE_COILS:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleWriteCoilsReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        case FunctionCode::WRITE_REGISTERS:
-            buildResponse(header.getTransactionId(), tx_buffer, [this, &header, &rx_buffer, &tx_buffer]() {
-                handleWriteRegistersReq(header.getTransactionId(), rx_buffer, tx_buffer);
-            });
-            break;
-
-        default:
-            throw std::logic_error("Function code not supported");
+    const modbus::tcp::Encoder encoder(m_unitId, header.getTransactionId());
+    const uint8_t functionCode = rx_buffer[offsetof(modbus::tcp::Header, functionCode)];
+
+    if (error != FrameError::OK) {
+        encoder.encodeErrorRsp(static_cast<FunctionCode>(functionCode), toExceptionCode(error), tx_buffer);
+        return;
     }
+
+    // the validator only accepts function codes present in the table
+    const Status status = (this->*getHandler(functionCode))(encoder, rx_buffer, tx_buffer);
+
+    if (status != Status::OK)
+        encoder.encodeErrorRsp(static_cast<FunctionCode>(functionCode), static_cast<ExceptionCode>(status), tx_buffer);
 }
 
 
-void ServerDevice::buildResponse(const TransactionId& transactionId, std::vector<uint8_t>& tx_buffer, std::function<void(void)> handler) {
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
+ServerDevice::RequestHandler ServerDevice::getHandler(uint8_t functionCode) {
+    static const RequestHandler handlers[] = {
+        nullptr,
+        &ServerDevice::handleReadCoilsReq,              // 0x01
+        &ServerDevice::handleReadDiscreteInputsReq,     // 0x02
+        &ServerDevice::handleReadHoldingRegistersReq,   // 0x03
+        &ServerDevice::handleReadInputRegistersReq,     // 0x04
+        &ServerDevice::handleWriteSingleCoilReq,        // 0x05
+        &ServerDevice::handleWriteSingleRegisterReq,    // 0x06
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+        &ServerDevice::handleWriteCoilsReq,             // 0x0F
+        &ServerDevice::handleWriteRegistersReq          // 0x10
+    };
 
-    try {
-        handler();
-    } catch (const FunctionCodeNotSupported& ex) {
-        encoder.encodeErrorRsp(FunctionCode::READ_COILS, ExceptionCode::ILLEGAL_FUNCTION, tx_buffer);
-    } catch (const NumBitsOutOfRange& ex) {
-        encoder.encodeErrorRsp(FunctionCode::READ_COILS, ExceptionCode::ILLEGAL_DATA_VALUE, tx_buffer);
-    } catch (const BadAddress& ex) {
-        encoder.encodeErrorRsp(FunctionCode::READ_COILS, ExceptionCode::ILLEGAL_DATA_ADDRESS, tx_buffer);
-    } catch (const FailedToReadInputs& ex) {
-        encoder.encodeErrorRsp(FunctionCode::READ_COILS, ExceptionCode::SLAVE_DEVICE_FAILURE, tx_buffer);
-    }
+    const RequestHandler handler = functionCode < sizeof(handlers) / sizeof(handlers[0]) ? handlers[functionCode] : nullptr;
+
+    if (handler == nullptr)
+        throw std::logic_error("Function code not supported");
+
+    return handler;
 }
 
 
-void ServerDevice::handleReadCoilsReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const {
+Status ServerDevice::handleReadCoilsReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::ReadCoilsReq view(rx_buffer);
 
-    std::vector<bool> coils;
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
+    const std::size_t count = view.getNumBits().get();
 
-    coils.reserve(view.getNumBits().get());
+    if (!isAddressRangeValid(view.getStartAddress().get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
 
-    const std::size_t start = view.getStartAddress().get();
-    const std::size_t end = start + view.getNumBits().get();
+    tx_buffer.resize(Encoder::readBitsRspSize(count));
 
-    for (std::size_t i = start; i < end; ++i)
-        coils.push_back(getCoil(modbus::tcp::Address(i)));
+    const Status status = readCoilsPacked(view.getStartAddress(), count, tx_buffer.data() + Encoder::readBitsRspSize(0));
 
-    encoder.encodeReadCoilsRsp(coils.begin(), coils.end(), tx_buffer);
+    if (status != Status::OK)
+        return status;
+
+    encoder.encodeReadBitsRspHeader(FunctionCode::READ_COILS, count, tx_buffer.data(), tx_buffer.size());
+
+    return Status::OK;
 }
 
 
-void ServerDevice::handleReadDiscreteInputsReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const {
-    modbus::tcp::decoder_views::ReadDiscreteInputsReq view(rx_buffer);;
+Status ServerDevice::handleReadDiscreteInputsReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+    modbus::tcp::decoder_views::ReadDiscreteInputsReq view(rx_buffer);
+
+    const std::size_t count = view.getNumBits().get();
+
+    if (!isAddressRangeValid(view.getStartAddress().get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    tx_buffer.resize(Encoder::readBitsRspSize(count));
 
-    std::vector<bool> inputs;
-    inputs.reserve(view.getNumBits().get());
+    const Status status = readDiscreteInputsPacked(view.getStartAddress(), count, tx_buffer.data() + Encoder::readBitsRspSize(0));
 
-    const std::size_t start = view.getStartAddress().get();
-    const std::size_t end = start + view.getNumBits().get();
+    if (status != Status::OK)
+        return status;
 
-    for (std::size_t i = start; i < end; ++i)
-        inputs.push_back(getDiscreteInput(modbus::tcp::Address(i)));
+    encoder.encodeReadBitsRspHeader(FunctionCode::READ_DISCRETE_INPUTS, count, tx_buffer.data(), tx_buffer.size());
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
-    encoder.encodeReadDiscreteInputsRsp(inputs.begin(), inputs.end(), tx_buffer);
+    return Status::OK;
 }
 
 
-void ServerDevice::handleReadHoldingRegistersReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const {
+Status ServerDevice::handleReadHoldingRegistersReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::ReadHoldingRegistersReq view(rx_buffer);
 
-    std::vector<uint16_t> regs;
-    regs.reserve(view.getNumRegs().get());
+    const std::size_t count = view.getNumRegs().get();
 
-    const std::size_t start = view.getStartAddress().get();
-    const std::size_t end = start + view.getNumRegs().get();
+    if (!isAddressRangeValid(view.getStartAddress().get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
 
-    for (std::size_t i = start; i < end; ++i)
-        regs.push_back(getHoldingRegister(modbus::tcp::Address(i)));
+    tx_buffer.resize(Encoder::readRegistersRspSize(count));
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
-    encoder.encodeReadHoldingRegistersRsp(regs.begin(), regs.end(), tx_buffer);
+    const Status status = readHoldingRegistersWire(view.getStartAddress(), count, tx_buffer.data() + Encoder::readRegistersRspSize(0));
+
+    if (status != Status::OK)
+        return status;
+
+    encoder.encodeReadRegistersRspHeader(FunctionCode::READ_HOLDING_REGISTERS, count, tx_buffer.data(), tx_buffer.size());
+
+    return Status::OK;
 }
 
 
-void ServerDevice::handleReadInputRegistersReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) const {
+Status ServerDevice::handleReadInputRegistersReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::ReadInputRegistersReq view(rx_buffer);
 
-    std::vector<uint16_t> regs;
-    regs.reserve(view.getNumRegs().get());
+    const std::size_t count = view.getNumRegs().get();
+
+    if (!isAddressRangeValid(view.getStartAddress().get(), count))
+        return Status::ILLEGAL_DATA_ADDRESS;
 
-    const std::size_t start = view.getStartAddress().get();
-    const std::size_t end = start + view.getNumRegs().get();
+    tx_buffer.resize(Encoder::readRegistersRspSize(count));
 
-    for (std::size_t i = start; i < end; ++i)
-        regs.push_back(getInputRegister(modbus::tcp::Address(i)));
+    const Status status = readInputRegistersWire(view.getStartAddress(), count, tx_buffer.data() + Encoder::readRegistersRspSize(0));
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
-    encoder.encodeReadInputRegistersRsp(regs.begin(), regs.end(), tx_buffer);
+    if (status != Status::OK)
+        return status;
+
+    encoder.encodeReadRegistersRspHeader(FunctionCode::READ_INPUT_REGISTERS, count, tx_buffer.data(), tx_buffer.size());
+
+    return Status::OK;
 }
 
 
-void ServerDevice::handleWriteSingleCoilReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+Status ServerDevice::handleWriteSingleCoilReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::WriteSingleCoilReq view(rx_buffer);
 
-    setCoil(view.getAddress(), view.getValue());
+    const Status status = writeCoil(view.getAddress(), view.getValue());
+
+    if (status != Status::OK)
+        return status;
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
     encoder.encodeWriteSingleCoilRsp(view.getAddress(), view.getValue(), tx_buffer);
+
+    return Status::OK;
 }
 
 
-void ServerDevice::handleWriteSingleRegisterReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+Status ServerDevice::handleWriteSingleRegisterReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::WriteSingleRegisterReq view(rx_buffer);
 
-    setRegister(view.getAddress(), view.getValue());
+    const Status status = writeRegister(view.getAddress(), view.getValue());
+
+    if (status != Status::OK)
+        return status;
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
     encoder.encodeWriteSingleRegisterRsp(view.getAddress(), view.getValue(), tx_buffer);
+
+    return Status::OK;
 }
 
 
-void ServerDevice::handleWriteCoilsReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+Status ServerDevice::handleWriteCoilsReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::WriteCoilsReq view(rx_buffer);
 
-    std::vector<bool> coils;
-    for (std::size_t i = 0; i < view.getNumBits().get(); ++i)
-        coils.push_back(view.getCoil(i));
+    if (!isAddressRangeValid(view.getStartAddress().get(), view.getNumBits().get()))
+        return Status::ILLEGAL_DATA_ADDRESS;
+
+    const Status status = writeCoilsPacked(view.getStartAddress(), view.getNumBits().get(), view.getBytes());
 
-    setCoils(view.getStartAddress(), coils);
+    if (status != Status::OK)
+        return status;
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
     encoder.encodeWriteCoilsRsp(view.getStartAddress(), view.getNumBits(), tx_buffer);
+
+    return Status::OK;
 }
 
 
-void ServerDevice::handleWriteRegistersReq(const TransactionId& transactionId, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+Status ServerDevice::handleWriteRegistersReq(const Encoder& encoder, const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
     modbus::tcp::decoder_views::WriteRegistersReq view(rx_buffer);
 
-    std::vector<uint16_t> regs;
-    for (std::size_t i = 0; i < view.getNumRegs().get(); ++i)
-        regs.push_back(view.getRegister(i));
+    if (!isAddressRangeValid(view.getStartAddress().get(), view.getNumRegs().get()))
+        return Status::ILLEGAL_DATA_ADDRESS;
 
-    setRegisters(view.getStartAddress(), regs);
+    const Status status = writeRegistersWire(view.getStartAddress(), view.getNumRegs().get(), view.getBytes());
+
+    if (status != Status::OK)
+        return status;
 
-    modbus::tcp::Encoder encoder(m_unitId, transactionId);
     encoder.encodeWriteRegistersRsp(view.getStartAddress(), view.getNumRegs(), tx_buffer);
+
+    return Status::OK;
+}
+
+
+bool ServerDevice::isAddressRangeValid(std::size_t start, std::size_t count) {
+    return start + count <= 0x10000;
+}
+
+
+ServerDevice::LegacyCall*& ServerDevice::currentLegacyCall() {
+    static thread_local LegacyCall* call = nullptr;
+    return call;
+}
+
+
+template <typename Handler>
+Status ServerDevice::callLegacy(Handler handler) {
+    struct Scope {
+        LegacyCall          call;
+        LegacyCall*         outer;
+
+        Scope() : call{false}, outer(currentLegacyCall()) { currentLegacyCall() = &call; }
+        ~Scope() { currentLegacyCall() = outer; }
+    } scope;
+
+    try {
+        handler();
+    } catch (const FunctionCodeNotSupported& ex) {
+        return Status::ILLEGAL_FUNCTION;
+    } catch (const NumBitsOutOfRange& ex) {
+        return Status::ILLEGAL_DATA_VALUE;
+    } catch (const BadAddress& ex) {
+        return Status::ILLEGAL_DATA_ADDRESS;
+    } catch (const FailedToReadInputs& ex) {
+        return Status::SLAVE_DEVICE_FAILURE;
+    }
+
+    return scope.call.unsupported ? Status::ILLEGAL_FUNCTION : Status::OK;
+}
+
+
+template <typename T>
+T ServerDevice::unsupported(FunctionCode code) {
+    LegacyCall* call = currentLegacyCall();
+
+    if (call == nullptr)
+        throw FunctionCodeNotSupported(code);
+
+    call->unsupported = true;
+    return T();
+}
+
+
+Status ServerDevice::readCoil(const Address& address, bool& value) const {
+    return callLegacy([&]() { value = getCoil(address); });
+}
+
+
+Status ServerDevice::readDiscreteInput(const Address& address, bool& value) const {
+    return callLegacy([&]() { value = getDiscreteInput(address); });
+}
+
+
+Status ServerDevice::readHoldingRegister(const Address& address, uint16_t& value) const {
+    return callLegacy([&]() { value = getHoldingRegister(address); });
+}
+
+
+Status ServerDevice::readInputRegister(const Address& address, uint16_t& value) const {
+    return callLegacy([&]() { value = getInputRegister(address); });
+}
+
+
+Status ServerDevice::writeCoil(const Address& address, bool value) {
+    return callLegacy([&]() { setCoil(address, value); });
+}
+
+
+Status ServerDevice::writeRegister(const Address& address, uint16_t value) {
+    return callLegacy([&]() { setRegister(address, value); });
+}
+
+
+Status ServerDevice::writeCoils(const Address& startAddress, const std::vector<bool>& coils) {
+    return callLegacy([&]() { setCoils(startAddress, coils); });
+}
+
+
+Status ServerDevice::writeRegisters(const Address& startAddress, const std::vector<uint16_t>& regs) {
+    return callLegacy([&]() { setRegisters(startAddress, regs); });
+}
+
+
+Status ServerDevice::readCoils(const Address& startAddress, std::size_t count, uint8_t* values) const {
+    for (std::size_t i = 0; i < count; ++i) {
+        bool value = false;
+        const Status status = readCoil(Address(startAddress.get() + i), value);
+
+        if (status != Status::OK)
+            return status;
+
+        values[i] = value;
+    }
+
+    return Status::OK;
+}
+
+
+Status ServerDevice::readDiscreteInputs(const Address& startAddress, std::size_t count, uint8_t* values) const {
+    for (std::size_t i = 0; i < count; ++i) {
+        bool value = false;
+        const Status status = readDiscreteInput(Address(startAddress.get() + i), value);
+
+        if (status != Status::OK)
+            return status;
+
+        values[i] = value;
+    }
+
+    return Status::OK;
+}
+
+
+Status ServerDevice::readHoldingRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const {
+    for (std::size_t i = 0; i < count; ++i) {
+        const Status status = readHoldingRegister(Address(startAddress.get() + i), values[i]);
+
+        if (status != Status::OK)
+            return status;
+    }
+
+    return Status::OK;
+}
+
+
+Status ServerDevice::readInputRegisters(const Address& startAddress, std::size_t count, uint16_t* values) const {
+    for (std::size_t i = 0; i < count; ++i) {
+        const Status status = readInputRegister(Address(startAddress.get() + i), values[i]);
+
+        if (status != Status::OK)
+            return status;
+    }
+
+    return Status::OK;
+}
+
+
+Status ServerDevice::readCoilsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const {
+    uint8_t values[MODBUS_MAX_NUM_BITS_IN_READ_REQUEST];
+    const Status status = readCoils(startAddress, count, values);
+
+    if (status == Status::OK)
+        packBits(values, count, packed);
+
+    return status;
+}
+
+
+Status ServerDevice::readDiscreteInputsPacked(const Address& startAddress, std::size_t count, uint8_t* packed) const {
+    uint8_t values[MODBUS_MAX_NUM_BITS_IN_READ_REQUEST];
+    const Status status = readDiscreteInputs(startAddress, count, values);
+
+    if (status == Status::OK)
+        packBits(values, count, packed);
+
+    return status;
+}
+
+
+Status ServerDevice::readHoldingRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const {
+    uint16_t regs[MODBUS_MAX_NUM_REGS_IN_READ_REQUEST];
+    const Status status = readHoldingRegisters(startAddress, count, regs);
+
+    if (status == Status::OK)
+        encodeRegisters(regs, count, wire);
+
+    return status;
+}
+
+
+Status ServerDevice::readInputRegistersWire(const Address& startAddress, std::size_t count, uint8_t* wire) const {
+    uint16_t regs[MODBUS_MAX_NUM_REGS_IN_READ_REQUEST];
+    const Status status = readInputRegisters(startAddress, count, regs);
+
+    if (status == Status::OK)
+        encodeRegisters(regs, count, wire);
+
+    return status;
+}
+
+
+Status ServerDevice::writeCoilsPacked(const Address& startAddress, std::size_t count, const uint8_t* packed) {
+    std::vector<bool> coils(count);
+
+    for (std::size_t i = 0; i < count; ++i)
+        coils[i] = (packed[i / 8] >> (i % 8)) & 1;
+
+    return writeCoils(startAddress, coils);
+}
+
+
+Status ServerDevice::writeRegistersWire(const Address& startAddress, std::size_t count, const uint8_t* wire) {
+    std::vector<uint16_t> regs(count);
+    decodeRegisters(wire, count, regs.data());
+
+    return writeRegisters(startAddress, regs);
 }
 
 
 bool ServerDevice::getCoil(const Address&) const {
-    throw FunctionCodeNotSupported(FunctionCode::READ_COILS);
+    return unsupported<bool>(FunctionCode::READ_COILS);
 }
 
 
 bool ServerDevice::getDiscreteInput(const Address&) const {
-    throw FunctionCodeNotSupported(FunctionCode::READ_DISCRETE_INPUTS);
+    return unsupported<bool>(FunctionCode::READ_DISCRETE_INPUTS);
 }
 
 
 uint16_t ServerDevice::getHoldingRegister(const Address&) const {
-    throw FunctionCodeNotSupported(FunctionCode::READ_HOLDING_REGISTERS);
+    return unsupported<uint16_t>(FunctionCode::READ_HOLDING_REGISTERS);
 }
 
 
 uint16_t ServerDevice::getInputRegister(const Address&) const {
-    throw FunctionCodeNotSupported(FunctionCode::READ_INPUT_REGISTERS);
+    return unsupported<uint16_t>(FunctionCode::READ_INPUT_REGISTERS);
 }
 
 
 void ServerDevice::setCoil(const Address&, bool) {
-    throw FunctionCodeNotSupported(FunctionCode::WRITE_COIL);
+    return unsupported<void>(FunctionCode::WRITE_COIL);
 }
 
 
 void ServerDevice::setRegister(const Address&, uint16_t) {
-    throw FunctionCodeNotSupported(FunctionCode::WRITE_REGISTER);
+    return unsupported<void>(FunctionCode::WRITE_REGISTER);
 }
 
 
 
 void ServerDevice::setCoils(const Address&, const std::vector<bool>&) {
-    throw FunctionCodeNotSupported(FunctionCode::WRITE_COILS);
+    return unsupported<void>(FunctionCode::WRITE_COILS);
 }
 
 
 void ServerDevice::setRegisters(const Address&, const std::vector<uint16_t>&) {
-    throw FunctionCodeNotSupported(FunctionCode::WRITE_REGISTERS);
+    return unsupported<void>(FunctionCode::WRITE_REGISTERS);
 }
 
 } // namespace tcp
@@ -0,0 +1,79 @@
+#ifndef MODBUS_SERVER_DEVICE_ROUTER_HPP
+#define MODBUS_SERVER_DEVICE_ROUTER_HPP
+
+#include "ModbusServerDevice.hpp"
+
+#include <array>
+
+
+namespace modbus {
+namespace tcp {
+
+// Gateway serving several units behind one endpoint. Requests are forwarded to the device
+// registered for their unit id; a unit id without a device is answered with exception code
+// GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND. The router does not own the devices.
+class ServerDeviceRouter : public ServerDevice {
+public:
+    inline                          ServerDeviceRouter();
+
+    inline void                     addDevice(ServerDevice& device);
+    inline void                     removeDevice(const UnitId& unitId);
+
+    inline void                     handleMessage(const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) override;
+
+private:
+    std::array<ServerDevice*, 256>  m_devices;
+};
+
+
+ServerDeviceRouter::ServerDeviceRouter() :
+    ServerDevice(UnitId(0))
+{
+    m_devices.fill(nullptr);
+}
+
+
+void ServerDeviceRouter::addDevice(ServerDevice& device) {
+    ServerDevice*& slot = m_devices[device.getUnitId().get()];
+
+    if (slot != nullptr)
+        throw std::logic_error("unit id already in use");
+
+    slot = &device;
+}
+
+
+void ServerDeviceRouter::removeDevice(const UnitId& unitId) {
+    m_devices[unitId.get()] = nullptr;
+}
+
+
+void ServerDeviceRouter::handleMessage(const std::vector<uint8_t>& rx_buffer, std::vector<uint8_t>& tx_buffer) {
+    if (rx_buffer.size() < sizeof(Header)) {
+        tx_buffer.clear();
+        return;
+    }
+
+    ServerDevice* device = m_devices[rx_buffer[offsetof(Header, unitId)]];
+
+    if (device != nullptr) {
+        device->handleMessage(rx_buffer, tx_buffer);
+        return;
+    }
+
+    if (isFramingError(validateRequest(rx_buffer))) {
+        tx_buffer.clear();
+        return;
+    }
+
+    modbus::tcp::decoder_views::Header header(rx_buffer);
+    modbus::tcp::Encoder encoder(header.getUnitId(), header.getTransactionId());
+
+    encoder.encodeErrorRsp(static_cast<FunctionCode>(rx_buffer[offsetof(Header, functionCode)]),
+                           ExceptionCode::GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND, tx_buffer);
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef MODBUS_SERVER_POOL_HPP
+#define MODBUS_SERVER_POOL_HPP
+
+#include "ModbusServer.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace modbus {
+namespace tcp {
+
+// Runs one Server per thread, each with its own io_service and its own acceptor bound to the same
+// endpoint with SO_REUSEPORT. The kernel spreads incoming connections across the acceptors and a
+// session stays on the thread that accepted it, so sessions never share state across threads.
+// The device is shared by all threads and must be safe for concurrent access.
+class ServerPool {
+public:
+    inline                                      ServerPool(std::size_t numThreads, ServerDevice& device);
+    inline                                     ~ServerPool();
+
+    // The limits apply to each thread's server on its own, the pool shares no state between threads.
+    inline void                                 setLimits(const Server::Limits& limits);
+
+    // All threads record into the same metrics, each into a shard of its own.
+    inline void                                 setMetrics(Metrics* metrics);
+
+    // Binds every thread's acceptor before any thread runs, so that a failure to bind (port in use,
+    // no SO_REUSEPORT, no permission) is thrown from here and leaves the pool stopped.
+    inline void                                 start(const boost::asio::ip::tcp::endpoint& ep);
+    inline void                                 stop();
+
+    inline std::size_t                          getNumThreads() const;
+
+private:
+    struct Shard {
+        boost::asio::io_service                 io;
+        std::unique_ptr<boost::asio::io_service::work> work;
+        std::unique_ptr<Server>                 server;
+        std::thread                             thread;
+    };
+
+    std::vector<std::unique_ptr<Shard>>         m_shards;
+    std::mutex                                  m_mutex;
+    std::condition_variable                     m_serversDone;
+    std::size_t                                 m_numRunningServers;
+    bool                                        m_running;
+
+    inline void                                 on_server_done();
+};
+
+
+ServerPool::ServerPool(std::size_t numThreads, ServerDevice& device) :
+    m_shards(),
+    m_mutex(),
+    m_serversDone(),
+    m_numRunningServers(0),
+    m_running(false)
+{
+    if (numThreads == 0)
+        throw std::logic_error("server pool needs at least one thread");
+
+    for (std::size_t i = 0; i < numThreads; ++i) {
+        m_shards.emplace_back(new Shard());
+        m_shards.back()->server.reset(new Server(m_shards.back()->io, device));
+        m_shards.back()->server->setReusePort(true);
+    }
+}
+
+
+ServerPool::~ServerPool() {
+    stop();
+}
+
+
+void ServerPool::setLimits(const Server::Limits& limits) {
+    for (auto& shard: m_shards)
+        shard->server->setLimits(limits);
+}
+
+
+void ServerPool::setMetrics(Metrics* metrics) {
+    for (auto& shard: m_shards)
+        shard->server->setMetrics(metrics);
+}
+
+
+void ServerPool::start(const boost::asio::ip::tcp::endpoint& ep) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_running)
+        return;
+
+    try {
+        for (auto& shard: m_shards)
+            shard->server->listen(ep);
+    } catch (...) {
+        for (auto& shard: m_shards)
+            shard->server->close();
+
+        throw;
+    }
+
+    m_running = true;
+    m_numRunningServers = m_shards.size();
+
+    for (auto& shard: m_shards) {
+        Shard* s = shard.get();
+
+        s->io.reset();
+        s->work.reset(new boost::asio::io_service::work(s->io));
+        s->server->start(ep, [this]() { on_server_done(); });
+        s->thread = std::thread([s]() { s->io.run(); });
+    }
+}
+
+
+void ServerPool::stop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_running)
+        return;
+
+    m_running = false;
+
+    for (auto& shard: m_shards)
+        shard->server->stop();
+
+    // each server reports done once its acceptor is closed and all its sessions are gone
+    m_serversDone.wait(lock, [this]() { return m_numRunningServers == 0; });
+
+    for (auto& shard: m_shards)
+        shard->work.reset();
+
+    lock.unlock();
+
+    for (auto& shard: m_shards)
+        shard->thread.join();
+}
+
+
+std::size_t ServerPool::getNumThreads() const {
+    return m_shards.size();
+}
+
+
+void ServerPool::on_server_done() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    --m_numRunningServers;
+    m_serversDone.notify_all();
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
@@ -2,8 +2,15 @@
 #define MODBUS_SERVER_SESSION_HPP
 
 
+#include "ModbusHandlerAllocator.hpp"
+#include "ModbusLog.hpp"
+#include "ModbusMetrics.hpp"
+#include "ModbusTimingWheel.hpp"
+
 #include <boost/asio.hpp>
-#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <sstream>
 
 namespace modbus {
 namespace tcp {
@@ -15,37 +22,115 @@ public:
     inline                          ~ServerSession();
 
     boost::asio::ip::tcp::socket&   socket();
+
+    // A session may be started again once it reported done; its buffers are kept for the next
+    // connection. done_cb is called when the connection is closed and no handler is pending.
     void                            start(std::function<void(void)> done_cb);
     inline void                     stop();
 
+    // Token bucket request limiting: requests beyond the burst that arrive faster than
+    // requestsPerSecond are answered with SLAVE_DEVICE_BUSY. Zero disables the limit.
+    void                            setRequestRate(double requestsPerSecond, double burst);
+
+    // Close the connection when no request arrives within idleTimeout, or a started frame is not
+    // complete within frameTimeout. Zero disables a timeout, a null wheel both.
+    void                            setTimeouts(TimingWheel* wheel, const TimingWheel::Interval& idleTimeout, const TimingWheel::Interval& frameTimeout);
+
+    // Record requests, exceptions, bytes and service times into metrics, which must outlive the
+    // session. Null disables recording.
+    void                            setMetrics(Metrics* metrics);
+
+    const boost::asio::ip::address& getClientAddress() const;
+
 private:
+    using Responses                 = std::vector<std::vector<uint8_t>>;
+    using Clock                     = std::chrono::steady_clock;
+
+    // reception stops while this many responses wait for the write in flight to complete
+    static const std::size_t        MAX_PENDING_RESPONSES = 64;
+
     ServerDevice                   &m_device;
     boost::asio::ip::tcp::socket    m_socket;
-    std::vector<uint8_t>            m_rx_buffer;
-    std::vector<uint8_t>            m_tx_buffer;
+    std::vector<uint8_t>            m_rx_buffer;    // room for many frames, filled by async_read_some
+    std::size_t                     m_rxBegin;
+    std::size_t                     m_rxEnd;
+    std::vector<uint8_t>            m_frame;        // the request being handled
+    Responses                       m_pending;      // responses queued for the next write
+    std::size_t                     m_numPending;
+    Responses                       m_sending;      // responses of the write in flight
+    std::vector<boost::asio::const_buffer> m_tx_buffers;
+    bool                            m_receiving;
+    bool                            m_sendInProgress;
+    bool                            m_receptionPaused;
+    bool                            m_finished;
+    HandlerMemory                   m_rx_handler_memory;
+    HandlerMemory                   m_tx_handler_memory;
     std::function<void(void)>       m_done_cb;
-
-    void                            init_header_reception();
-    void                            on_header_received(const boost::system::error_code& ec);
-    void                            init_payload_reception();
-    void                            on_payload_received(const boost::system::error_code& ec);
+    boost::asio::ip::address        m_client;
+    double                          m_requestRate;
+    double                          m_burst;
+    double                          m_tokens;
+    Clock::time_point               m_lastRefill;
+    TimingWheel*                    m_wheel;
+    TimingWheel::Entry              m_timeout;
+    TimingWheel::Interval           m_idleTimeout;
+    TimingWheel::Interval           m_frameTimeout;
+    bool                            m_partialFrame;     // the timeout armed is the frame timeout
+    Metrics*                        m_metrics;
+    Metrics::Connection*            m_connection;       // registered while the connection is open
+
+    void                            init_reception();
+    void                            on_data_received(const boost::system::error_code& ec, std::size_t bytes_received);
+    void                            process_frames();
+    bool                            handle_request();
+    void                            refill_tokens();
+    void                            update_timeout();
     void                            init_response_sending();
     void                            on_response_sent(const boost::system::error_code& ec);
+    void                            finish();
+    void                            check_done();
 };
 
 
 ServerSession::ServerSession(boost::asio::io_service& io, ServerDevice& device) :
     m_device(device),
     m_socket(io),
-    m_rx_buffer(),
-    m_tx_buffer()
+    m_rx_buffer(16 * MODBUS_MAX_ADU_LENGTH),
+    m_rxBegin(0),
+    m_rxEnd(0),
+    m_frame(),
+    m_pending(),
+    m_numPending(0),
+    m_sending(),
+    m_tx_buffers(),
+    m_receiving(false),
+    m_sendInProgress(false),
+    m_receptionPaused(false),
+    m_finished(false),
+    m_rx_handler_memory(),
+    m_tx_handler_memory(),
+    m_client(),
+    m_requestRate(0),
+    m_burst(0),
+    m_tokens(0),
+    m_lastRefill(),
+    m_wheel(nullptr),
+    m_timeout([this]() { finish(); }),
+    m_idleTimeout(0),
+    m_frameTimeout(0),
+    m_partialFrame(false),
+    m_metrics(nullptr),
+    m_connection(nullptr)
 {
-    std::cout << "new session " << this << std::endl;
+    MODBUS_LOG_DEBUG("new session " << this);
 }
 
 
 ServerSession::~ServerSession() {
-    std::cout << "end session " << this << std::endl;
+    if (m_connection)
+        m_metrics->closeConnection(m_connection);
+
+    MODBUS_LOG_DEBUG("end session " << this);
 }
 
 
@@ -56,86 +141,283 @@ boost::asio::ip::tcp::socket& ServerSession::socket() {
 
 void ServerSession::start(std::function<void(void)> done_cb) {
     m_done_cb = done_cb;
-    init_header_reception();
+
+    m_rxBegin = 0;
+    m_rxEnd = 0;
+    m_numPending = 0;
+    m_receptionPaused = false;
+    m_finished = false;
+
+    boost::system::error_code ec;
+    const boost::asio::ip::tcp::endpoint peer = m_socket.remote_endpoint(ec);
+    m_client = peer.address();
+
+    if (m_metrics) {
+        std::ostringstream os;
+        os << peer;
+        m_connection = m_metrics->openConnection(os.str());
+    }
+
+    m_tokens = m_burst;
+    m_lastRefill = Clock::now();
+    m_partialFrame = false;
+
+    update_timeout();
+    init_reception();
 }
 
 
-void ServerSession::init_header_reception() {
-    auto self = this->shared_from_this();
+void ServerSession::setRequestRate(double requestsPerSecond, double burst) {
+    m_requestRate = requestsPerSecond;
+    m_burst = std::max(burst, 1.0);
+}
 
-    m_rx_buffer.resize(sizeof(modbus::tcp::Header));
 
-    boost::asio::async_read(
-        m_socket,
-        boost::asio::buffer(m_rx_buffer, sizeof(modbus::tcp::Header)),
-        [self, this](const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
-            on_header_received(ec);
-        });
+void ServerSession::setTimeouts(TimingWheel* wheel, const TimingWheel::Interval& idleTimeout, const TimingWheel::Interval& frameTimeout) {
+    m_wheel = wheel;
+    m_idleTimeout = idleTimeout;
+    m_frameTimeout = frameTimeout;
 }
 
 
-void ServerSession::on_header_received(const boost::system::error_code& ec) {
-    if (ec) {
-        m_done_cb();
-        m_done_cb = nullptr;
+void ServerSession::setMetrics(Metrics* metrics) {
+    m_metrics = metrics;
+}
+
+
+const boost::asio::ip::address& ServerSession::getClientAddress() const {
+    return m_client;
+}
+
+
+void ServerSession::init_reception() {
+    // keep room for at least one complete frame behind the data received so far
+    if (m_rx_buffer.size() - m_rxEnd < MODBUS_MAX_ADU_LENGTH) {
+        std::memmove(m_rx_buffer.data(), m_rx_buffer.data() + m_rxBegin, m_rxEnd - m_rxBegin);
+        m_rxEnd -= m_rxBegin;
+        m_rxBegin = 0;
+    }
+
+    auto self = this->shared_from_this();
+    m_receiving = true;
+
+    m_socket.async_read_some(
+        boost::asio::buffer(m_rx_buffer.data() + m_rxEnd, m_rx_buffer.size() - m_rxEnd),
+        makeAllocHandler(m_rx_handler_memory, [self, this](const boost::system::error_code& ec, std::size_t bytes_received) {
+            on_data_received(ec, bytes_received);
+        }));
+}
+
+
+void ServerSession::on_data_received(const boost::system::error_code& ec, std::size_t bytes_received) {
+    m_receiving = false;
+
+    // the client is done sending, the responses it is still owed go out before the connection is closed
+    if (ec == boost::asio::error::eof && !m_finished) {
+        m_finished = true;
+        check_done();
+        return;
+    }
+
+    if (ec || m_finished) {
+        finish();
         return;
     }
 
-    init_payload_reception();
+    m_rxEnd += bytes_received;
+
+    if (m_requestRate > 0)
+        refill_tokens();
+
+    process_frames();
 }
 
 
-void ServerSession::init_payload_reception() {
-    modbus::tcp::decoder_views::Header view_header(m_rx_buffer);
+void ServerSession::process_frames() {
+    // handle every complete frame in the buffer, a partial one is completed by the next read
+    while (m_rxEnd - m_rxBegin >= sizeof(modbus::tcp::Header)) {
+        if (m_numPending >= MAX_PENDING_RESPONSES) {
+            if (m_sendInProgress) {
+                // the client does not read its responses, continue once the write completes
+                m_receptionPaused = true;
+                return;
+            }
 
-    std::size_t payload_size = view_header.getLength() - 2;
+            init_response_sending();
+        }
 
-    m_rx_buffer.resize(sizeof(modbus::tcp::Header) + payload_size);
-    uint8_t* ptr = m_rx_buffer.data() + sizeof(modbus::tcp::Header);
+        const uint8_t* frame = m_rx_buffer.data() + m_rxBegin;
 
-    boost::asio::async_read(
-        m_socket,
-        boost::asio::buffer(ptr, payload_size),
-        [this](const boost::system::error_code& ec, std::size_t) {
-            on_payload_received(ec);
-        });
+        if (validateHeader(frame, m_rxEnd - m_rxBegin) != FrameError::OK) {
+            finish();
+            return;
+        }
+
+        std::size_t size = ntohs(reinterpret_cast<const modbus::tcp::Header*>(frame)->length) + 6;
+
+        if (m_rxEnd - m_rxBegin < size)
+            break;
+
+        m_frame.assign(frame, frame + size);
+        m_rxBegin += size;
+
+        if (!handle_request()) {
+            finish();
+            return;
+        }
+    }
+
+    if (m_rxBegin == m_rxEnd) {
+        m_rxBegin = 0;
+        m_rxEnd = 0;
+    }
+
+    // all responses to the frames of this read go out together
+    if (m_numPending > 0 && !m_sendInProgress)
+        init_response_sending();
+
+    update_timeout();
+    init_reception();
 }
 
 
-void ServerSession::on_payload_received(const boost::system::error_code& ec) {
-    if (ec) {
-        m_done_cb();
-        m_done_cb = nullptr;
-        return;
+bool ServerSession::handle_request() {
+    // response buffers are kept across writes, so their capacity is reused
+    if (m_numPending == m_pending.size())
+        m_pending.emplace_back();
+
+    std::vector<uint8_t>& response = m_pending[m_numPending];
+    const Clock::time_point begin = m_metrics ? Clock::now() : Clock::time_point();
+
+    if (m_requestRate > 0 && m_tokens < 1) {
+        decoder_views::Header header(m_frame);
+        Encoder encoder(header.getUnitId(), header.getTransactionId());
+        encoder.encodeErrorRsp(static_cast<FunctionCode>(m_frame[offsetof(Header, functionCode)]), ExceptionCode::SLAVE_DEVICE_BUSY, response);
+    } else {
+        m_tokens -= 1;
+        m_device.handleMessage(m_frame, response);
+    }
+
+    if (response.empty())
+        return false;
+
+    if (m_metrics) {
+        const bool exception = (response[offsetof(Header, functionCode)] & 0x80) != 0;
+
+        m_metrics->recordServed(m_frame[offsetof(Header, functionCode)], m_frame.size(), response.size(), exception,
+                                std::chrono::duration_cast<Metrics::Duration>(Clock::now() - begin));
+        m_connection->record(m_frame.size(), response.size(), exception);
     }
 
-    m_device.handleMessage(m_rx_buffer, m_tx_buffer);
-    init_response_sending();
+    ++m_numPending;
+    return true;
+}
+
+
+void ServerSession::refill_tokens() {
+    // once per read, all frames of a read share the same clock sample
+    const Clock::time_point now = Clock::now();
+    const double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+
+    m_tokens = std::min(m_burst, m_tokens + elapsed * m_requestRate);
+    m_lastRefill = now;
+}
+
+
+void ServerSession::update_timeout() {
+    if (m_wheel == nullptr)
+        return;
+
+    const bool partialFrame = m_rxBegin != m_rxEnd && m_frameTimeout.total_milliseconds() > 0;
+
+    // a partial frame keeps the deadline it got when it started
+    if (partialFrame && m_partialFrame)
+        return;
+
+    m_partialFrame = partialFrame;
+
+    const TimingWheel::Interval& timeout = partialFrame ? m_frameTimeout : m_idleTimeout;
+
+    if (timeout.total_milliseconds() > 0)
+        m_wheel->schedule(m_timeout, timeout);
+    else
+        m_wheel->cancel(m_timeout);
 }
 
 
 void ServerSession::init_response_sending() {
     auto self = this->shared_from_this();
 
+    std::swap(m_pending, m_sending);
+
+    m_tx_buffers.clear();
+    for (std::size_t i = 0; i < m_numPending; ++i)
+        m_tx_buffers.push_back(boost::asio::buffer(m_sending[i]));
+
+    m_numPending = 0;
+    m_sendInProgress = true;
+
     boost::asio::async_write(
         m_socket,
-        boost::asio::buffer(m_tx_buffer),
-        [self, this](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
+        m_tx_buffers,
+        makeAllocHandler(m_tx_handler_memory, [self, this](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
             on_response_sent(ec);
-        });
+        }));
 }
 
 
 void ServerSession::on_response_sent(const boost::system::error_code& ec) {
+    m_sendInProgress = false;
+
     if (ec) {
-        if (m_done_cb) {
-            m_done_cb();
-            m_done_cb = nullptr;
-        }
+        finish();
         return;
     }
 
-    init_header_reception();
+    // everything that was processed during the write goes out in one go
+    if (m_numPending > 0)
+        init_response_sending();
+
+    if (m_finished) {
+        check_done();
+    } else if (m_receptionPaused) {
+        m_receptionPaused = false;
+        process_frames();
+    }
+}
+
+
+void ServerSession::finish() {
+    m_finished = true;
+
+    // On a timeout or an error. Closing cancels the pending read as well as a write stuck on a client
+    // that does not read. Responses not written yet are dropped, including those for valid frames
+    // that preceded a framing error in the same read.
+    boost::system::error_code ec;
+    m_socket.close(ec);
+
+    check_done();
+}
+
+
+void ServerSession::check_done() {
+    if (!m_finished || m_receiving || m_sendInProgress || !m_done_cb)
+        return;
+
+    if (m_wheel)
+        m_wheel->cancel(m_timeout);
+
+    if (m_connection) {
+        m_metrics->closeConnection(m_connection);
+        m_connection = nullptr;
+    }
+
+    boost::system::error_code ec;
+    m_socket.close(ec);
+
+    std::function<void(void)> done_cb;
+    std::swap(done_cb, m_done_cb);
+    done_cb();
 }
 
 
@@ -0,0 +1,212 @@
+#ifndef MODBUS_TIMING_WHEEL_HPP
+#define MODBUS_TIMING_WHEEL_HPP
+
+#include <boost/asio.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace modbus {
+namespace tcp {
+
+// Coarse timeouts for many connections on one io_service, driven by a single deadline_timer.
+// Entries are intrusive list nodes owned by the caller, so scheduling, rescheduling and cancelling
+// are O(1) and never allocate. Timeouts fire with the resolution of one tick, never early. The
+// timer only runs while entries are scheduled.
+class TimingWheel {
+public:
+    using Interval                          = boost::posix_time::milliseconds;
+
+    class Entry {
+    public:
+        inline explicit                     Entry(std::function<void(void)> on_timeout);
+        inline                             ~Entry();
+
+                                            Entry(const Entry&) = delete;
+        Entry&                              operator=(const Entry&) = delete;
+
+        inline bool                         isScheduled() const;
+
+    private:
+        friend class TimingWheel;
+
+        std::function<void(void)>           m_on_timeout;
+        TimingWheel*                        m_wheel;
+        Entry*                              m_prev;
+        Entry*                              m_next;
+        std::size_t                         m_slot;
+        std::size_t                         m_rounds;   // full turns of the wheel left before expiry
+    };
+
+    inline                                  TimingWheel(boost::asio::io_service& io, const Interval& resolution, std::size_t numSlots);
+    inline                                 ~TimingWheel();
+
+                                            TimingWheel(const TimingWheel&) = delete;
+    TimingWheel&                            operator=(const TimingWheel&) = delete;
+
+    inline void                             schedule(Entry& entry, const Interval& timeout);
+    inline void                             cancel(Entry& entry);
+
+private:
+    boost::asio::deadline_timer             m_timer;
+    Interval                                m_resolution;
+    std::vector<Entry*>                     m_slots;    // heads of the per slot lists
+    std::size_t                             m_cursor;
+    std::size_t                             m_numEntries;
+    bool                                    m_ticking;
+    std::shared_ptr<char>                   m_alive;    // expires with the wheel, checked by a completed tick
+
+    inline void                             link(Entry& entry, std::size_t slot);
+    inline void                             unlink(Entry& entry);
+    inline void                             init_tick();
+    inline void                             on_tick();
+};
+
+
+TimingWheel::Entry::Entry(std::function<void(void)> on_timeout) :
+    m_on_timeout(on_timeout),
+    m_wheel(nullptr),
+    m_prev(nullptr),
+    m_next(nullptr),
+    m_slot(0),
+    m_rounds(0)
+{}
+
+
+TimingWheel::Entry::~Entry() {
+    if (m_wheel)
+        m_wheel->cancel(*this);
+}
+
+
+bool TimingWheel::Entry::isScheduled() const {
+    return m_wheel != nullptr;
+}
+
+
+TimingWheel::TimingWheel(boost::asio::io_service& io, const Interval& resolution, std::size_t numSlots) :
+    m_timer(io),
+    m_resolution(resolution),
+    m_slots(numSlots, nullptr),
+    m_cursor(0),
+    m_numEntries(0),
+    m_ticking(false),
+    m_alive(std::make_shared<char>(0))
+{
+    if (numSlots == 0 || resolution.total_milliseconds() <= 0)
+        throw std::logic_error("timing wheel needs slots and a positive resolution");
+}
+
+
+TimingWheel::~TimingWheel() {
+    // the pending wait completes with operation_aborted, or finds m_alive expired if it had
+    // already completed; either way its handler returns without touching the wheel
+    boost::system::error_code ignored;
+    m_timer.cancel(ignored);
+    m_alive.reset();
+
+    for (Entry* head: m_slots) {
+        for (Entry* entry = head; entry != nullptr; entry = entry->m_next)
+            entry->m_wheel = nullptr;
+    }
+}
+
+
+void TimingWheel::schedule(Entry& entry, const Interval& timeout) {
+    if (entry.m_wheel)
+        unlink(entry);
+
+    // round up, plus one tick since the current one is already partly over
+    const std::size_t ticks = (timeout.total_milliseconds() + m_resolution.total_milliseconds() - 1) / m_resolution.total_milliseconds() + 1;
+
+    entry.m_rounds = (ticks - 1) / m_slots.size();
+    link(entry, (m_cursor + ticks) % m_slots.size());
+
+    if (!m_ticking)
+        init_tick();
+}
+
+
+void TimingWheel::cancel(Entry& entry) {
+    if (entry.m_wheel)
+        unlink(entry);
+}
+
+
+void TimingWheel::link(Entry& entry, std::size_t slot) {
+    Entry*& head = m_slots[slot];
+
+    entry.m_wheel = this;
+    entry.m_slot = slot;
+    entry.m_prev = nullptr;
+    entry.m_next = head;
+
+    if (head)
+        head->m_prev = &entry;
+
+    head = &entry;
+    ++m_numEntries;
+}
+
+
+void TimingWheel::unlink(Entry& entry) {
+    if (entry.m_prev)
+        entry.m_prev->m_next = entry.m_next;
+    else
+        m_slots[entry.m_slot] = entry.m_next;
+
+    if (entry.m_next)
+        entry.m_next->m_prev = entry.m_prev;
+
+    entry.m_wheel = nullptr;
+    entry.m_prev = nullptr;
+    entry.m_next = nullptr;
+    --m_numEntries;
+}
+
+
+void TimingWheel::init_tick() {
+    m_ticking = true;
+    m_timer.expires_from_now(m_resolution);
+    std::weak_ptr<char> alive = m_alive;
+
+    m_timer.async_wait([this, alive](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted || alive.expired())
+            return;
+
+        on_tick();
+    });
+}
+
+
+void TimingWheel::on_tick() {
+    m_ticking = false;
+
+    m_cursor = (m_cursor + 1) % m_slots.size();
+
+    Entry* entry = m_slots[m_cursor];
+
+    while (entry != nullptr) {
+        Entry* next = entry->m_next;
+
+        if (entry->m_rounds > 0) {
+            --entry->m_rounds;
+        } else {
+            // the callback may reschedule or destroy the entry, so it is unlinked first
+            unlink(*entry);
+            entry->m_on_timeout();
+        }
+
+        entry = next;
+    }
+
+    if (m_numEntries > 0)
+        init_tick();
+}
+
+} // namespace tcp
+} // namespace modbus
+
+#endif
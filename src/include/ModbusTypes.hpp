@@ -17,6 +17,11 @@ struct NumBitsOutOfRange : public error {
 };
 
 
+struct BufferTooSmall : public error {
+    BufferTooSmall(const std::string& msg) : error(msg) {}
+};
+
+
 struct Header {
     uint16_t                        transactionId;
     uint16_t                        protocolId;
@@ -1,6 +1,8 @@
 #ifndef SOCKET_CONNECTOR_HPP
 #define SOCKET_CONNECTOR_HPP
 
+#include "ModbusLog.hpp"
+
 
 class SocketConnector : public std::enable_shared_from_this<SocketConnector> {
 public:
@@ -54,7 +56,7 @@ SocketConnector::SocketConnector(boost::asio::io_service& io, const Endpoint& ep
 
 
 SocketConnector::~SocketConnector() {
-    std::cout << "~SocketConnector" << std::endl;
+    MODBUS_LOG_DEBUG("~SocketConnector " << this);
 }
 
 
@@ -93,10 +95,10 @@ void SocketConnector::async_connect(Socket& sock, SocketConnectedCb cb) {
 
 void SocketConnector::initConnection(Socket& sock) {
     auto self = shared_from_this();
-    std::cout << "Attempting connection to " << m_endpoint << std::endl;
+    MODBUS_LOG_INFO("attempting connection to " << m_endpoint);
 
     sock.async_connect(m_endpoint, [self, this, &sock](const boost::system::error_code& ec) {
-        std::cout << "on connected ec=" << ec.message() << std::endl;
+        MODBUS_LOG_INFO("connection to " << m_endpoint << ": " << ec.message());
 
         if (ec == boost::asio::error::operation_aborted) {
             postCallback(ec);
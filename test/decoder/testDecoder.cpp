@@ -3,6 +3,8 @@
 #include "Catch.hpp"
 
 #include "ModbusDecoder.hpp"
+#include "ModbusFrameValidator.hpp"
 
 #include "testcases_decoder.hpp"
+#include "testcases_frame_validator.hpp"
 
@@ -214,6 +214,29 @@ TEST_CASE("decode write coils req", "[decoder]") {
 }
 
 
+TEST_CASE("decode coils in bulk", "[decoder]") {
+    namespace mt = modbus::tcp;
+
+    std::vector<uint8_t> req{0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x0f, 0x10, 0x20, 0x00, 0x0A, 0x02, 0b01010101, 0b00000011};
+    mt::decoder_views::WriteCoilsReq reqView(req);
+    std::vector<uint8_t> coils(10);
+
+    reqView.getCoils(coils.data());
+    REQUIRE(coils == (std::vector<uint8_t>{1,0,1,0,1,0,1,0,1,1}));
+    REQUIRE(reqView.getNumBytes() == 2);
+    REQUIRE(reqView.getBytes() == req.data() + 13);
+
+    std::vector<uint8_t> rsp{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x02, 0x02, 0b01010101, 0b00000011};
+    mt::decoder_views::ReadDiscreteInputsRsp rspView(rsp);
+    std::vector<uint8_t> inputs(12);
+
+    rspView.getBits(inputs.data(), inputs.size());
+    REQUIRE(inputs == (std::vector<uint8_t>{1,0,1,0,1,0,1,0,1,1,0,0}));
+    REQUIRE(rspView.getNumBytes() == 2);
+    REQUIRE(rspView.getBytes() == rsp.data() + 9);
+}
+
+
 TEST_CASE("decode write coils rsp", "[decoder]") {
     namespace mt = modbus::tcp;
 
@@ -239,6 +262,24 @@ TEST_CASE("decode write registers req", "[decoder]") {
 }
 
 
+TEST_CASE("decode registers in bulk", "[decoder]") {
+    namespace mt = modbus::tcp;
+
+    std::vector<uint8_t> req{0x00, 0x02, 0x00, 0x00, 0x00, 0x0d, 0xab, 0x10, 0x10, 0x20, 0x00, 0x03, 0x06, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+    std::vector<uint16_t> regs(3);
+
+    mt::decoder_views::WriteRegistersReq(req).getRegisters(regs.data());
+    REQUIRE(regs == (std::vector<uint16_t>{0x0102, 0x0304, 0x0506}));
+    REQUIRE(mt::decoder_views::WriteRegistersReq(req).getBytes() == req.data() + 13);
+
+    std::vector<uint8_t> rsp{0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04};
+    regs.resize(2);
+
+    mt::decoder_views::ReadHoldingRegistersRsp(rsp).getRegisters(regs.data());
+    REQUIRE(regs == (std::vector<uint16_t>{0x0102, 0x0304}));
+}
+
+
 TEST_CASE("decode write registers rsp", "[decoder]") {
     namespace mt = modbus::tcp;
 
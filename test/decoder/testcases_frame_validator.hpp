@@ -0,0 +1,57 @@
+#ifndef TESTCASES_FRAME_VALIDATOR_HPP
+#define TESTCASES_FRAME_VALIDATOR_HPP
+
+
+TEST_CASE("validate well formed requests", "[frame validator]") {
+    namespace mt = modbus::tcp;
+
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x01, 0x10, 0x20, 0x07, 0xd0}) == mt::FrameError::OK);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x03, 0x10, 0x20, 0x00, 0x7d}) == mt::FrameError::OK);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x05, 0x10, 0x20, 0xff, 0x00}) == mt::FrameError::OK);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x06, 0x10, 0x20, 0x12, 0x34}) == mt::FrameError::OK);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x0f, 0x10, 0x20, 0x00, 0x0A, 0x02, 0x55, 0x03}) == mt::FrameError::OK);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x0b, 0xab, 0x10, 0x10, 0x20, 0x00, 0x02, 0x04, 0x01, 0x02, 0x03, 0x04}) == mt::FrameError::OK);
+}
+
+
+TEST_CASE("validate malformed requests", "[frame validator]") {
+    namespace mt = modbus::tcp;
+
+    // framing
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab}) == mt::FrameError::TOO_SHORT);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x01, 0x00, 0x06, 0xab, 0x01, 0x10, 0x20, 0x00, 0x04}) == mt::FrameError::BAD_PROTOCOL_ID);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x01, 0xab, 0x01}) == mt::FrameError::BAD_LENGTH);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0xff, 0xab, 0x01}) == mt::FrameError::BAD_LENGTH);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x01, 0x10, 0x20, 0x00, 0x04}) == mt::FrameError::BAD_LENGTH);
+
+    // PDU
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x07, 0x10, 0x20, 0x00, 0x04}) == mt::FrameError::ILLEGAL_FUNCTION);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x01, 0x10, 0x20, 0x00}) == mt::FrameError::BAD_SIZE);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x02, 0x10, 0x20, 0x00, 0x00}) == mt::FrameError::BAD_QUANTITY);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x04, 0x10, 0x20, 0x00, 0x7e}) == mt::FrameError::BAD_QUANTITY);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x05, 0x10, 0x20, 0x00, 0x01}) == mt::FrameError::BAD_VALUE);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x0f, 0x10, 0x20, 0x00, 0x11, 0x02, 0x55, 0x03}) == mt::FrameError::BAD_BYTE_COUNT);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x0a, 0xab, 0x10, 0x10, 0x20, 0x00, 0x02, 0x04, 0x01, 0x02, 0x03}) == mt::FrameError::BAD_SIZE);
+    REQUIRE(mt::validateRequest({0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x10, 0x10, 0x20, 0x00, 0x7c, 0xf8}) == mt::FrameError::BAD_QUANTITY);
+
+    REQUIRE(mt::isFramingError(mt::FrameError::BAD_LENGTH));
+    REQUIRE_FALSE(mt::isFramingError(mt::FrameError::BAD_QUANTITY));
+    REQUIRE(mt::toExceptionCode(mt::FrameError::ILLEGAL_FUNCTION) == mt::ExceptionCode::ILLEGAL_FUNCTION);
+    REQUIRE(mt::toExceptionCode(mt::FrameError::BAD_BYTE_COUNT) == mt::ExceptionCode::ILLEGAL_DATA_VALUE);
+}
+
+
+TEST_CASE("validate responses", "[frame validator]") {
+    namespace mt = modbus::tcp;
+
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04}) == mt::FrameError::OK);
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x02, 0x02, 0x55, 0x03}) == mt::FrameError::OK);
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x81, 0x02}) == mt::FrameError::OK);
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x10, 0x10, 0x20, 0x00, 0x0A}) == mt::FrameError::OK);
+
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x03, 0x06, 0x01, 0x02, 0x03, 0x04}) == mt::FrameError::BAD_BYTE_COUNT);
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x03, 0x03, 0x01, 0x02, 0x03}) == mt::FrameError::BAD_BYTE_COUNT);
+    REQUIRE(mt::validateResponse({0x00, 0x02, 0x00, 0x00, 0x00, 0x04, 0xab, 0x81, 0x02, 0x00}) == mt::FrameError::BAD_SIZE);
+}
+
+#endif
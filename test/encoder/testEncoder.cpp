@@ -6,3 +6,5 @@
 
 #include "testcases_types.hpp"
 #include "testcases_encoder.hpp"
+#include "testcases_byte_order.hpp"
+#include "testcases_bit_packing.hpp"
@@ -0,0 +1,85 @@
+#ifndef TESTCASES_BIT_PACKING_HPP
+#define TESTCASES_BIT_PACKING_HPP
+
+#include "ModbusBitPacking.hpp"
+
+
+TEST_CASE("pack and unpack every byte value", "[bit_packing]") {
+    namespace mt = modbus::tcp;
+
+    bool allMatch = true;
+
+    for (unsigned int i = 0; i < 256; ++i) {
+        const uint8_t byte = i;
+        uint8_t values[8];
+        uint8_t packed = 0;
+
+        mt::unpackBits(&byte, 8, values);
+
+        for (std::size_t bit = 0; bit < 8; ++bit)
+            allMatch = allMatch && values[bit] == ((byte >> bit) & 1);
+
+        // any non-zero byte counts as a set bit
+        for (std::size_t bit = 0; bit < 8; ++bit)
+            values[bit] *= 0x80 >> bit;
+
+        mt::packBits(values, 8, &packed);
+        allMatch = allMatch && packed == byte;
+    }
+
+    REQUIRE(allMatch);
+}
+
+
+TEST_CASE("pack and unpack bit arrays", "[bit_packing]") {
+    namespace mt = modbus::tcp;
+
+    for (std::size_t numBits = 1; numBits <= mt::MODBUS_MAX_NUM_BITS_IN_READ_REQUEST; numBits += 37) {
+        std::vector<uint8_t> values(numBits);
+        std::vector<uint8_t> expected((numBits + 7) / 8, 0);
+
+        for (std::size_t i = 0; i < numBits; ++i) {
+            values[i] = (i * 7 + i / 3) % 5 == 0 ? 0xff : 0;
+            if (values[i])
+                expected[i / 8] |= 1 << (i % 8);
+        }
+
+        std::vector<uint8_t> packed(expected.size(), 0xaa);
+        mt::packBits(values.data(), numBits, packed.data());
+        REQUIRE(packed == expected);
+
+        std::vector<uint8_t> unpacked(numBits);
+        mt::unpackBits(packed.data(), numBits, unpacked.data());
+
+        for (std::size_t i = 0; i < numBits; ++i)
+            values[i] = values[i] != 0;
+
+        REQUIRE(unpacked == values);
+
+        std::vector<uint64_t> words((numBits + 63) / 64);
+        mt::unpackBits(packed.data(), numBits, words.data());
+
+        std::vector<uint8_t> repacked(expected.size());
+        mt::packBits(words.data(), numBits, repacked.data());
+        REQUIRE(repacked == expected);
+    }
+}
+
+
+TEST_CASE("encode coils from byte arrays", "[bit_packing]") {
+    namespace mt = modbus::tcp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(2));
+    std::vector<uint8_t> coils{1, 0, 1, 1, 0, 0, 1, 1, 1, 0};
+    std::vector<uint8_t> target{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x01, 0x02, 0xcd, 0x01};
+    std::vector<uint8_t> encoded;
+
+    encoder.encodeReadCoilsRsp(coils.cbegin(), coils.cend(), encoded);
+    REQUIRE(target == encoded);
+
+    bool flags[10] = {true, false, true, true, false, false, true, true, true, false};
+    encoder.encodeReadCoilsRsp(flags, flags + 10, encoded);
+    REQUIRE(target == encoded);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef TESTCASES_BYTE_ORDER_HPP
+#define TESTCASES_BYTE_ORDER_HPP
+
+#include "ModbusByteOrder.hpp"
+
+
+TEST_CASE("encode and decode registers in bulk", "[byte_order]") {
+    namespace mt = modbus::tcp;
+
+    for (std::size_t numRegs = 0; numRegs <= 125; ++numRegs) {
+        std::vector<uint16_t> regs(numRegs);
+        for (std::size_t i = 0; i < numRegs; ++i)
+            regs[i] = 0x0102 + 0x0202 * i;
+
+        // one spare byte in front, so the kernels see a misaligned payload like inside a frame
+        std::vector<uint8_t> wire(2*numRegs + 1);
+        mt::encodeRegisters(regs.data(), numRegs, wire.data() + 1);
+
+        bool bigEndian = true;
+        for (std::size_t i = 0; i < numRegs; ++i)
+            bigEndian = bigEndian && wire[1 + 2*i] == (regs[i] >> 8) && wire[2 + 2*i] == (regs[i] & 0xff);
+
+        REQUIRE(bigEndian);
+
+        std::vector<uint16_t> decoded(numRegs);
+        mt::decodeRegisters(wire.data() + 1, numRegs, decoded.data());
+
+        REQUIRE(decoded == regs);
+    }
+}
+
+
+#ifdef MODBUS_HAVE_X86_KERNELS
+TEST_CASE("byte swap kernels agree with scalar version", "[byte_order]") {
+    namespace bo = modbus::tcp::byte_order;
+
+    std::vector<uint8_t> src(2*125);
+    for (std::size_t i = 0; i < src.size(); ++i)
+        src[i] = i;
+
+    for (std::size_t numRegs = 0; numRegs <= 125; ++numRegs) {
+        std::vector<uint8_t> expected(2*numRegs);
+        bo::swapScalar(src.data(), numRegs, expected.data());
+
+        if (__builtin_cpu_supports("ssse3")) {
+            std::vector<uint8_t> swapped(2*numRegs);
+            bo::swapSsse3(src.data(), numRegs, swapped.data());
+            REQUIRE(swapped == expected);
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+            std::vector<uint8_t> swapped(2*numRegs);
+            bo::swapAvx2(src.data(), numRegs, swapped.data());
+            REQUIRE(swapped == expected);
+        }
+    }
+}
+#endif
+
+#endif
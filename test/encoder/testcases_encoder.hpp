@@ -1,6 +1,10 @@
 #ifndef TESTCASES_ENCODER_HPP
 #define TESTCASES_ENCODER_HPP
 
+#include <list>
+#include <sstream>
+#include <iterator>
+
 TEST_CASE("encode read coils req", "[encoder]") {
     namespace mt = modbus::tcp;
 
@@ -269,4 +273,92 @@ TEST_CASE("encode write registeres rsp", "[encoder]") {
     REQUIRE(target == encoded);
 }
 
+TEST_CASE("encode into raw buffer", "[encoder]") {
+    namespace mt = modbus::tcp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(2));
+    std::vector<uint16_t> regs{0x0102, 0x0304, 0x0506};
+    std::vector<uint8_t> target{0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x03, 0x06, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+    uint8_t buffer[mt::Encoder::readRegistersRspSize(3) + 4];
+
+    std::size_t size = encoder.encodeReadHoldingRegistersRsp(regs.begin(), regs.end(), buffer, sizeof(buffer));
+
+    REQUIRE(size == target.size());
+    REQUIRE(target == std::vector<uint8_t>(buffer, buffer + size));
+}
+
+
+TEST_CASE("encode into raw buffer, coils", "[encoder]") {
+    namespace mt = modbus::tcp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(2));
+    std::vector<bool> coils{true, false, true, true, false, false, true, true, true, false};
+    std::vector<uint8_t> target{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x01, 0x02, 0xcd, 0x01};
+    uint8_t buffer[mt::Encoder::readBitsRspSize(10)];
+
+    std::fill(buffer, buffer + sizeof(buffer), 0xff);
+    std::size_t size = encoder.encodeReadCoilsRsp(coils.begin(), coils.end(), buffer, sizeof(buffer));
+
+    REQUIRE(size == target.size());
+    REQUIRE(target == std::vector<uint8_t>(buffer, buffer + size));
+}
+
+
+TEST_CASE("encode into raw buffer, insufficient capacity", "[encoder]") {
+    namespace mt = modbus::tcp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(2));
+    std::vector<uint16_t> regs{0x0102, 0x0304, 0x0506};
+    uint8_t buffer[mt::MODBUS_MAX_ADU_LENGTH];
+
+    REQUIRE_THROWS_AS(encoder.encodeReadCoilsReq(mt::Address(1), mt::NumBits(8), buffer, mt::Encoder::readReqSize() - 1), mt::BufferTooSmall);
+    REQUIRE_THROWS_AS(encoder.encodeWriteRegistersReq(mt::Address(1), regs.begin(), regs.end(), buffer, mt::Encoder::writeRegistersReqSize(3) - 1), mt::BufferTooSmall);
+    REQUIRE_THROWS_AS(encoder.encodeErrorRsp(mt::FunctionCode::READ_COILS, mt::ExceptionCode::ILLEGAL_FUNCTION, buffer, 0), mt::BufferTooSmall);
+}
+
+
+TEST_CASE("encoded message sizes", "[encoder]") {
+    namespace mt = modbus::tcp;
+
+    static_assert(mt::Encoder::readReqSize() == 12, "read request size");
+    static_assert(mt::Encoder::writeSingleValueSize() == 12, "write single value size");
+    static_assert(mt::Encoder::writeCoilsReqSize(10) == 15, "write coils request size");
+    static_assert(mt::Encoder::writeRegistersReqSize(3) == 19, "write registers request size");
+    static_assert(mt::Encoder::readBitsRspSize(8) == 10, "read bits response size");
+    static_assert(mt::Encoder::readRegistersRspSize(0x7d) == 259, "read registers response size");
+    static_assert(mt::Encoder::writeValuesRspSize() == 12, "write values response size");
+    static_assert(mt::Encoder::errorRspSize() == 9, "error response size");
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(2));
+    std::vector<uint8_t> encoded;
+
+    encoder.encodeReadInputRegistersReq(mt::Address(1), mt::NumRegs(4), encoded);
+    REQUIRE(encoded.size() == mt::Encoder::readReqSize());
+}
+
+TEST_CASE("encode from non random access iterators", "[encoder]") {
+    namespace mt = modbus::tcp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(2));
+    std::list<bool> coils{true, false, true, true, false, false, true, true, true, false};
+    std::list<uint16_t> regs{0x0102, 0x0304, 0x0506};
+    std::vector<uint8_t> coilsTarget{0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x0f, 0x10, 0x20, 0x00, 0x0a, 0x02, 0xcd, 0x01};
+    std::vector<uint8_t> regsTarget{0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x04, 0x06, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+    std::vector<uint8_t> encoded;
+
+    encoder.encodeWriteCoilsReq(mt::Address(0x1020), coils.begin(), coils.end(), encoded);
+    REQUIRE(coilsTarget == encoded);
+
+    encoder.encodeReadInputRegistersRsp(regs.begin(), regs.end(), encoded);
+    REQUIRE(regsTarget == encoded);
+
+    std::istringstream input("1 2 3 4 5 6");
+    uint8_t buffer[mt::MODBUS_MAX_ADU_LENGTH];
+    std::size_t size = encoder.encodeReadHoldingRegistersRsp(std::istream_iterator<uint16_t>(input), std::istream_iterator<uint16_t>(), buffer, sizeof(buffer));
+
+    REQUIRE(size == mt::Encoder::readRegistersRspSize(6));
+    REQUIRE(buffer[8] == 12);
+    REQUIRE(buffer[20] == 6);
+}
+
 #endif
@@ -0,0 +1,145 @@
+#define CATCH_CONFIG_MAIN
+#define MODBUS_LOG_LEVEL MODBUS_LOG_LEVEL_INFO
+
+#include "Catch.hpp"
+#include "ModbusLog.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+class CollectingSink : public modbus::LogSink {
+public:
+    void write(const modbus::LogRecord& record) override {
+        levels.push_back(record.level);
+        messages.push_back(std::string(record.text, record.length));
+    }
+
+    std::vector<modbus::LogLevel>   levels;
+    std::vector<std::string>        messages;
+};
+
+int evaluated(int& count) {
+    return ++count;
+}
+
+} // namespace
+
+
+TEST_CASE("Logger - records reach the sink in order", "[Logger]") {
+    auto sink = std::make_shared<CollectingSink>();
+    auto& logger = modbus::Logger::instance();
+
+    logger.start(sink);
+    MODBUS_LOG_INFO("first " << 1);
+    MODBUS_LOG_WARNING("second " << 2.5);
+    MODBUS_LOG_ERROR("third");
+    logger.stop();
+
+    REQUIRE(sink->messages == (std::vector<std::string>{"first 1", "second 2.5", "third"}));
+    REQUIRE(sink->levels == (std::vector<modbus::LogLevel>{modbus::LogLevel::INFO, modbus::LogLevel::WARNING, modbus::LogLevel::ERROR}));
+}
+
+
+TEST_CASE("Logger - levels below MODBUS_LOG_LEVEL are not evaluated", "[Logger]") {
+    auto sink = std::make_shared<CollectingSink>();
+    int count = 0;
+
+    modbus::Logger::instance().start(sink);
+    MODBUS_LOG_DEBUG("debug " << evaluated(count));
+    MODBUS_LOG_INFO("info " << evaluated(count));
+    modbus::Logger::instance().stop();
+
+    REQUIRE(count == 1);
+    REQUIRE(sink->messages == (std::vector<std::string>{"info 1"}));
+}
+
+
+TEST_CASE("Logger - nothing is formatted while stopped", "[Logger]") {
+    int count = 0;
+
+    MODBUS_LOG_ERROR("error " << evaluated(count));
+
+    REQUIRE(count == 0);
+}
+
+
+TEST_CASE("Logger - long messages are truncated", "[Logger]") {
+    auto sink = std::make_shared<CollectingSink>();
+
+    modbus::Logger::instance().start(sink);
+    MODBUS_LOG_INFO(std::string(1000, 'x') << "tail");
+    modbus::Logger::instance().stop();
+
+    REQUIRE(sink->messages.size() == 1);
+    REQUIRE(sink->messages[0] == std::string(modbus::LogRecord::MAX_LENGTH, 'x'));
+}
+
+
+TEST_CASE("Logger - a full queue drops records instead of blocking", "[Logger]") {
+    auto& logger = modbus::Logger::instance();
+    auto sink = std::make_shared<CollectingSink>();
+    const std::size_t dropped = logger.getNumDropped();
+    const std::size_t queueSize = modbus::Logger::QUEUE_SIZE;
+
+    // not running, so nothing drains the queue
+    for (std::size_t i = 0; i < queueSize + 10; ++i)
+        REQUIRE(logger.push(modbus::LogLevel::INFO, "x", 1) == (i < queueSize));
+
+    REQUIRE(logger.getNumDropped() == dropped + 10);
+
+    logger.start(sink);
+    logger.stop();
+
+    REQUIRE(sink->messages.size() == queueSize);
+}
+
+
+TEST_CASE("Logger - concurrent producers", "[Logger]") {
+    auto sink = std::make_shared<CollectingSink>();
+    auto& logger = modbus::Logger::instance();
+    const std::size_t dropped = logger.getNumDropped();
+    std::vector<std::thread> producers;
+
+    logger.start(sink);
+
+    for (int p = 0; p < 4; ++p) {
+        producers.emplace_back([p]() {
+            for (int i = 0; i < 2000; ++i) {
+                MODBUS_LOG_INFO(p << ":" << i);
+
+                if (i % 100 == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    for (auto& producer: producers)
+        producer.join();
+
+    logger.stop();
+
+    // every record is either written or counted as dropped
+    REQUIRE(sink->messages.size() + (logger.getNumDropped() - dropped) == 8000);
+}
+
+
+TEST_CASE("StreamLogSink - writes time, level and message", "[Logger]") {
+    std::ostringstream os;
+    modbus::StreamLogSink sink(os);
+    modbus::LogRecord record;
+
+    record.time = std::chrono::system_clock::time_point(std::chrono::microseconds(1500000042));
+    record.level = modbus::LogLevel::WARNING;
+    record.length = 5;
+    std::memcpy(record.text, "hello", 5);
+
+    sink.write(record);
+
+    REQUIRE(os.str() == "1500.000042 WARNING hello\n");
+}
@@ -0,0 +1,176 @@
+#define CATCH_CONFIG_MAIN
+
+#include "Catch.hpp"
+#include "ModbusMetrics.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+TEST_CASE("LatencyHistogram - buckets are exact below the sub bucket count and bounded above", "[Metrics]") {
+    using Histogram = modbus::LatencyHistogram;
+    const std::size_t numBuckets = Histogram::NUM_BUCKETS;
+
+    for (uint64_t value = 0; value < 8; ++value) {
+        REQUIRE(Histogram::getBucket(value) == value);
+        REQUIRE(Histogram::getBucketUpperBound(Histogram::getBucket(value)) == value);
+    }
+
+    for (uint64_t value: std::vector<uint64_t>{8, 9, 15, 16, 17, 100, 1000, 123456789, 0xFFFFFFFFFFFFFFFFull}) {
+        const std::size_t bucket = Histogram::getBucket(value);
+        const uint64_t upper = Histogram::getBucketUpperBound(bucket);
+
+        REQUIRE(bucket < numBuckets);
+        REQUIRE(upper >= value);
+        REQUIRE(upper - value <= value / 8);
+        REQUIRE(Histogram::getBucket(upper) == bucket);
+    }
+}
+
+
+TEST_CASE("LatencyHistogram - percentiles within the bucket error", "[Metrics]") {
+    modbus::LatencyHistogram histogram;
+
+    REQUIRE(histogram.getPercentile(0.5) == 0);
+
+    for (uint64_t value = 1; value <= 1000; ++value)
+        histogram.record(value * 1000);
+
+    REQUIRE(histogram.getCount() == 1000);
+    REQUIRE(histogram.getSum() == 500500000);
+    REQUIRE(histogram.getMax() == 1000000);
+
+    REQUIRE(histogram.getPercentile(0.5) >= 500000);
+    REQUIRE(histogram.getPercentile(0.5) <= 500000 + 500000 / 8);
+    REQUIRE(histogram.getPercentile(0.99) >= 990000);
+    REQUIRE(histogram.getPercentile(1.0) == 1000000);
+
+    modbus::LatencyHistogram other;
+    other.record(2000000);
+    histogram.merge(other);
+
+    REQUIRE(histogram.getCount() == 1001);
+    REQUIRE(histogram.getMax() == 2000000);
+}
+
+
+TEST_CASE("Metrics - shards of all threads are merged into the snapshot", "[Metrics]") {
+    modbus::Metrics metrics;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&metrics]() {
+            for (int i = 0; i < 1000; ++i) {
+                metrics.recordServed(0x03, 12, 17, false, std::chrono::microseconds(10));
+                metrics.recordServed(0x83, 12, 9, true, std::chrono::microseconds(20));
+            }
+        });
+    }
+
+    // snapshots may be taken while recording
+    for (int i = 0; i < 10; ++i)
+        metrics.getSnapshot();
+
+    for (auto& thread: threads)
+        thread.join();
+
+    metrics.recordPolled(0x01, 10, 12, false, std::chrono::milliseconds(1));
+
+    const modbus::MetricsSnapshot snapshot = metrics.getSnapshot();
+
+    REQUIRE(snapshot.served.size() == 1);
+    REQUIRE(snapshot.served.count(0x03) == 1);
+
+    const auto& served = snapshot.served.at(0x03);
+    REQUIRE(served.requests == 8000);
+    REQUIRE(served.exceptions == 4000);
+    REQUIRE(served.bytesReceived == 8000 * 12);
+    REQUIRE(served.bytesSent == 4000 * 17 + 4000 * 9);
+    REQUIRE(served.latency.getCount() == 8000);
+    REQUIRE(served.latency.getMax() == 20000);
+
+    REQUIRE(snapshot.polled.size() == 1);
+    REQUIRE(snapshot.polled.at(0x01).requests == 1);
+    REQUIRE(snapshot.polled.at(0x01).latency.getSum() == 1000000);
+}
+
+
+TEST_CASE("Metrics - one thread recording into several instances in turn", "[Metrics]") {
+    // more instances than a thread caches shards for, so some of them are looked up again
+    std::vector<std::unique_ptr<modbus::Metrics>> instances;
+
+    for (int i = 0; i < 12; ++i)
+        instances.emplace_back(new modbus::Metrics());
+
+    for (int round = 0; round < 100; ++round) {
+        for (std::size_t i = 0; i < instances.size(); ++i)
+            instances[i]->recordServed(0x03, i + 1, 1, false, std::chrono::microseconds(1));
+    }
+
+    for (std::size_t i = 0; i < instances.size(); ++i) {
+        const modbus::MetricsSnapshot snapshot = instances[i]->getSnapshot();
+
+        REQUIRE(snapshot.served.at(0x03).requests == 100);
+        REQUIRE(snapshot.served.at(0x03).bytesReceived == 100 * (i + 1));
+    }
+}
+
+
+TEST_CASE("Metrics - open connections are part of the snapshot", "[Metrics]") {
+    modbus::Metrics metrics;
+
+    modbus::Metrics::Connection* first = metrics.openConnection("127.0.0.1:1000");
+    modbus::Metrics::Connection* second = metrics.openConnection("127.0.0.1:1001");
+
+    first->record(12, 10, false);
+    first->record(12, 9, true);
+    second->record(12, 10, false);
+
+    metrics.closeConnection(second);
+
+    const modbus::MetricsSnapshot snapshot = metrics.getSnapshot();
+
+    REQUIRE(snapshot.connections.size() == 1);
+    REQUIRE(snapshot.connections[0].peer == "127.0.0.1:1000");
+    REQUIRE(snapshot.connections[0].requests == 2);
+    REQUIRE(snapshot.connections[0].exceptions == 1);
+    REQUIRE(snapshot.connections[0].bytesReceived == 24);
+    REQUIRE(snapshot.connections[0].bytesSent == 19);
+}
+
+
+TEST_CASE("Metrics - Prometheus text exposition", "[Metrics]") {
+    modbus::Metrics metrics;
+
+    metrics.recordServed(0x03, 12, 17, false, std::chrono::microseconds(100));
+    metrics.recordServed(0x83, 12, 9, true, std::chrono::microseconds(100));
+    metrics.openConnection("127.0.0.1:1000")->record(12, 17, false);
+
+    std::ostringstream os;
+    modbus::writePrometheus(os, metrics.getSnapshot());
+    const std::string text = os.str();
+
+    REQUIRE(text.find("# TYPE modbus_server_requests_total counter\nmodbus_server_requests_total{function_code=\"3\"} 2\n") != std::string::npos);
+    REQUIRE(text.find("modbus_server_exceptions_total{function_code=\"3\"} 1\n") != std::string::npos);
+    REQUIRE(text.find("modbus_server_sent_bytes_total{function_code=\"3\"} 26\n") != std::string::npos);
+    REQUIRE(text.find("# TYPE modbus_server_service_time_seconds summary\n") != std::string::npos);
+    REQUIRE(text.find("modbus_server_service_time_seconds{function_code=\"3\",quantile=\"0.99\"} 0.0001") != std::string::npos);
+    REQUIRE(text.find("modbus_server_service_time_seconds_count{function_code=\"3\"} 2\n") != std::string::npos);
+    REQUIRE(text.find("# TYPE modbus_poller_requests_total counter\n") != std::string::npos);
+    REQUIRE(text.find("modbus_poller_requests_total{") == std::string::npos);
+    REQUIRE(text.find("modbus_connection_requests_total{peer=\"127.0.0.1:1000\"} 1\n") != std::string::npos);
+
+    const std::string path = "test_metrics.prom";
+    modbus::writePrometheusFile(path, metrics.getSnapshot());
+
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+
+    REQUIRE(content.str() == text);
+    std::remove(path.c_str());
+}
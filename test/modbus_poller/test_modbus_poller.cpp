@@ -10,9 +10,11 @@
 #include "SocketConnector.hpp"
 #include "ModbusPollTask.hpp"
 #include "ModbusPoller.hpp"
+#include "ModbusPollerPool.hpp"
 #include "ModbusServerDevice.hpp"
 #include "ModbusServer.hpp"
 #include <thread>
+#include <algorithm>
 
 
 boost::asio::ip::tcp::endpoint make_endpoint(const std::string& ip, uint16_t port) {
@@ -179,3 +181,532 @@ TEST_CASE("ModbusPoller - one polling task", "[ModbusPoller]") {
     test.start();
 }
 
+
+
+TEST_CASE("ModbusPoller - pipelined polling tasks", "[ModbusPoller]") {
+    class MyTest : public modbus::tcp::ServerDevice {
+    public:
+        MyTest() :
+            modbus::tcp::ServerDevice(modbus::tcp::UnitId(0xab)),
+            m_io(),
+            m_server(m_io, *this),
+            m_poller(std::make_shared<ModbusPoller>(m_io, make_endpoint("127.0.0.1", 8502), make_millisecs(100))),
+            m_requests(NUM_TASKS),
+            m_expectedSamples(NUM_TASKS),
+            m_rxSamples(NUM_TASKS),
+            m_numReceivedSamples(NUM_TASKS, 0),
+            m_done(false)
+        {
+            m_poller->setMaxRequestsInFlight(4);
+
+            for (std::size_t i = 0; i < NUM_TASKS; ++i) {
+                modbus::tcp::Encoder encoder(modbus::tcp::UnitId(0xab), modbus::tcp::TransactionId(0x1000 + i));
+                std::vector<uint16_t> regs{static_cast<uint16_t>(i), static_cast<uint16_t>(i + 1)};
+
+                encoder.encodeReadHoldingRegistersReq(modbus::tcp::Address(i), modbus::tcp::NumRegs(2), m_requests[i]);
+                encoder.encodeReadHoldingRegistersRsp(regs.begin(), regs.end(), m_expectedSamples[i]);
+
+                m_poller->addPollTask(m_requests[i], m_rxSamples[i], make_millisecs(100), [this, i]() {
+                    REQUIRE(m_rxSamples[i] == m_expectedSamples[i]);
+                    m_numReceivedSamples[i]++;
+
+                    if (!m_done && std::all_of(m_numReceivedSamples.begin(), m_numReceivedSamples.end(), [](std::size_t n) { return n >= 2; })) {
+                        m_done = true;
+                        m_poller->cancel();
+                        m_poller = nullptr;
+                        m_server.stop();
+                    }
+                });
+            }
+        }
+
+        ~MyTest() {
+            REQUIRE(m_done == true);
+        }
+
+        void start() {
+            m_server.start(make_endpoint("127.0.0.1", 8502), []() {});
+            m_poller->start();
+            m_io.run();
+        }
+
+    protected:
+        uint16_t getHoldingRegister(const modbus::tcp::Address& addr) const override {
+            return addr.get();
+        }
+
+    private:
+        using PModbusPoller = std::shared_ptr<ModbusPoller>;
+        enum { NUM_TASKS = 10 };
+
+        boost::asio::io_service             m_io;
+        modbus::tcp::Server                 m_server;
+        PModbusPoller                       m_poller;
+
+        std::vector<std::vector<uint8_t>>   m_requests;
+        std::vector<std::vector<uint8_t>>   m_expectedSamples;
+        std::vector<std::vector<uint8_t>>   m_rxSamples;
+        std::vector<std::size_t>            m_numReceivedSamples;
+        bool                                m_done;
+    };
+
+    MyTest test;
+    test.start();
+}
+
+
+TEST_CASE("ModbusPoller - responses demultiplexed by transaction id", "[ModbusPoller]") {
+    namespace mt = modbus::tcp;
+
+    boost::asio::io_service         io;
+    OneTimeTcpAcceptor              acceptor(io);
+    std::shared_ptr<ModbusPoller>   poller = std::make_shared<ModbusPoller>(io, make_endpoint("127.0.0.1", 8502), make_millisecs(100));
+
+    std::vector<uint8_t> req1, req2, rsp1, rsp2, rxSample1, rxSample2, serverRx(24), serverTx;
+    std::vector<uint16_t> regs1{0x1111, 0x2222}, regs2{0x3333};
+    std::size_t numSamples = 0;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x0007));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0010), mt::NumRegs(2), req1);
+    encoder.encodeReadHoldingRegistersRsp(regs1.begin(), regs1.end(), rsp1);
+    encoder.encodeReadInputRegistersReq(mt::Address(0x0020), mt::NumRegs(1), req2);
+    encoder.encodeReadInputRegistersRsp(regs2.begin(), regs2.end(), rsp2);
+
+    auto onSample = [&]() {
+        if (++numSamples == 2) {
+            poller->cancel();
+            acceptor.getConnectedClient().close();
+        }
+    };
+
+    poller->setMaxRequestsInFlight(2);
+    poller->addPollTask(req1, rxSample1, make_millisecs(10000), onSample);
+    poller->addPollTask(req2, rxSample2, make_millisecs(10000), onSample);
+    poller->start();
+
+    auto onRequestsReceived = [&](const boost::system::error_code& ec, std::size_t /* bytes_transferred */) {
+        REQUIRE(!ec);
+
+        // answer in reverse order with a stray frame in between, all in a single segment
+        std::vector<uint8_t> stray(rsp1);
+        stray[0] = 0xde; stray[1] = 0xad;
+
+        for (std::size_t offset: {12, 0}) {
+            std::vector<uint8_t> rsp(serverRx[offset + 7] == 0x03 ? rsp1 : rsp2);
+            rsp[0] = serverRx[offset];
+            rsp[1] = serverRx[offset + 1];
+
+            serverTx.insert(serverTx.end(), rsp.begin(), rsp.end());
+            if (offset != 0)
+                serverTx.insert(serverTx.end(), stray.begin(), stray.end());
+        }
+
+        boost::asio::write(acceptor.getConnectedClient(), boost::asio::buffer(serverTx));
+    };
+
+    acceptor.asyncAccept(make_endpoint("127.0.0.1", 8502), [&]() {
+        boost::asio::async_read(acceptor.getConnectedClient(), boost::asio::buffer(serverRx), onRequestsReceived);
+    });
+
+    io.run();
+    poller = nullptr;
+
+    REQUIRE(numSamples == 2);
+    REQUIRE(rxSample1 == rsp1);
+    REQUIRE(rxSample2 == rsp2);
+}
+
+
+TEST_CASE("ModbusPoller - adjacent read requests are coalesced", "[ModbusPoller]") {
+    class MyTest : public modbus::tcp::ServerDevice {
+    public:
+        MyTest() :
+            modbus::tcp::ServerDevice(modbus::tcp::UnitId(0xab)),
+            m_io(),
+            m_server(m_io, *this),
+            m_poller(std::make_shared<ModbusPoller>(m_io, make_endpoint("127.0.0.1", 8502), make_millisecs(100))),
+            m_requests(),
+            m_expectedSamples(),
+            m_rxSamples(),
+            m_numReceivedSamples(0),
+            m_numRegisterReads(0),
+            m_numCoilReads(0)
+        {
+            addRegistersRequest(100, 10);
+            addRegistersRequest(105, 10);
+            addRegistersRequest(115, 5);
+            addRegistersRequest(125, 6);
+            addCoilsRequest(0, 5);
+            addCoilsRequest(5, 8);
+
+            m_rxSamples.resize(m_requests.size());
+            m_poller->setMaxRequestsInFlight(4);
+
+            for (std::size_t i = 0; i < m_requests.size(); ++i) {
+                m_poller->addPollTask(m_requests[i], m_rxSamples[i], make_millisecs(10000), [this, i]() {
+                    REQUIRE(m_rxSamples[i] == m_expectedSamples[i]);
+
+                    if (++m_numReceivedSamples == m_requests.size()) {
+                        m_poller->cancel();
+                        m_poller = nullptr;
+                        m_server.stop();
+                    }
+                });
+            }
+        }
+
+        ~MyTest() {
+            REQUIRE(m_numReceivedSamples == m_requests.size());
+            REQUIRE(m_numRegisterReads == 20 + 6);
+            REQUIRE(m_numCoilReads == 13);
+        }
+
+        void start() {
+            m_server.start(make_endpoint("127.0.0.1", 8502), []() {});
+            m_poller->start();
+            m_io.run();
+        }
+
+    protected:
+        uint16_t getHoldingRegister(const modbus::tcp::Address& addr) const override {
+            m_numRegisterReads++;
+            return addr.get() * 3;
+        }
+
+        bool getCoil(const modbus::tcp::Address& addr) const override {
+            m_numCoilReads++;
+            return addr.get() % 3 == 0;
+        }
+
+    private:
+        using PModbusPoller = std::shared_ptr<ModbusPoller>;
+
+        boost::asio::io_service             m_io;
+        modbus::tcp::Server                 m_server;
+        PModbusPoller                       m_poller;
+
+        std::vector<std::vector<uint8_t>>   m_requests;
+        std::vector<std::vector<uint8_t>>   m_expectedSamples;
+        std::vector<std::vector<uint8_t>>   m_rxSamples;
+        std::size_t                         m_numReceivedSamples;
+        mutable std::size_t                 m_numRegisterReads;
+        mutable std::size_t                 m_numCoilReads;
+
+        void addRegistersRequest(uint16_t startAddress, uint8_t numRegs) {
+            modbus::tcp::Encoder encoder(modbus::tcp::UnitId(0xab), modbus::tcp::TransactionId(startAddress));
+            std::vector<uint16_t> regs;
+
+            for (uint16_t addr = startAddress; addr < startAddress + numRegs; ++addr)
+                regs.push_back(addr * 3);
+
+            m_requests.emplace_back();
+            m_expectedSamples.emplace_back();
+            encoder.encodeReadHoldingRegistersReq(modbus::tcp::Address(startAddress), modbus::tcp::NumRegs(numRegs), m_requests.back());
+            encoder.encodeReadHoldingRegistersRsp(regs.begin(), regs.end(), m_expectedSamples.back());
+        }
+
+        void addCoilsRequest(uint16_t startAddress, uint16_t numCoils) {
+            modbus::tcp::Encoder encoder(modbus::tcp::UnitId(0xab), modbus::tcp::TransactionId(startAddress));
+            std::vector<bool> coils;
+
+            for (uint16_t addr = startAddress; addr < startAddress + numCoils; ++addr)
+                coils.push_back(addr % 3 == 0);
+
+            m_requests.emplace_back();
+            m_expectedSamples.emplace_back();
+            encoder.encodeReadCoilsReq(modbus::tcp::Address(startAddress), modbus::tcp::NumBits(numCoils), m_requests.back());
+            encoder.encodeReadCoilsRsp(coils.begin(), coils.end(), m_expectedSamples.back());
+        }
+    };
+
+    MyTest test;
+    test.start();
+}
+
+
+TEST_CASE("ModbusPoller - due task is skipped while its previous poll is pending", "[ModbusPoller]") {
+    namespace mt = modbus::tcp;
+
+    boost::asio::io_service         io;
+    OneTimeTcpAcceptor              acceptor(io);
+    boost::asio::deadline_timer     timer(io);
+    std::shared_ptr<ModbusPoller>   poller = std::make_shared<ModbusPoller>(io, make_endpoint("127.0.0.1", 8502), make_millisecs(100));
+
+    std::vector<uint8_t> req, rxSample, serverRx(1024);
+    std::size_t numReceived = 0;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x0001));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0010), mt::NumRegs(2), req);
+
+    poller->addPollTask(req, rxSample, make_millisecs(20), []() {});
+    poller->start();
+
+    acceptor.asyncAccept(make_endpoint("127.0.0.1", 8502), [&]() {
+        // never answer, the task is due ~15 times meanwhile but must be sent only once
+        timer.expires_from_now(make_millisecs(300));
+        timer.async_wait([&](const boost::system::error_code& ec) {
+            REQUIRE(!ec);
+            numReceived = acceptor.getConnectedClient().read_some(boost::asio::buffer(serverRx));
+            poller->cancel();
+            acceptor.getConnectedClient().close();
+        });
+    });
+
+    io.run();
+    poller = nullptr;
+
+    REQUIRE(numReceived == req.size());
+}
+
+
+TEST_CASE("ModbusPoller - zero poll interval is rejected", "[ModbusPoller]") {
+    namespace mt = modbus::tcp;
+
+    boost::asio::io_service         io;
+    std::shared_ptr<ModbusPoller>   poller = std::make_shared<ModbusPoller>(io, make_endpoint("127.0.0.1", 8502), make_millisecs(100));
+
+    std::vector<uint8_t> req, rxSample;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x0001));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0010), mt::NumRegs(2), req);
+
+    REQUIRE_THROWS_AS(poller->addPollTask(req, rxSample, make_millisecs(0), []() {}), std::logic_error);
+    REQUIRE_THROWS_AS(poller->addPollTask(req, make_millisecs(0)), std::logic_error);
+    REQUIRE(poller->getPollRate() == 0);
+}
+
+
+TEST_CASE("ModbusPoller - poll into register image", "[ModbusPoller]") {
+    class MyTest : public modbus::tcp::ServerDevice {
+    public:
+        MyTest() :
+            modbus::tcp::ServerDevice(modbus::tcp::UnitId(0xab)),
+            m_io(),
+            m_server(m_io, *this),
+            m_poller(std::make_shared<ModbusPoller>(m_io, make_endpoint("127.0.0.1", 8502), make_millisecs(100))),
+            m_timer(m_io)
+        {
+            std::vector<uint8_t> req;
+            modbus::tcp::Encoder encoder(modbus::tcp::UnitId(0xab), modbus::tcp::TransactionId(0x0001));
+
+            encoder.encodeReadInputRegistersReq(modbus::tcp::Address(0x0100), modbus::tcp::NumRegs(3), req);
+            m_registers = m_poller->addPollTask(req, make_millisecs(50));
+
+            encoder.encodeReadDiscreteInputsReq(modbus::tcp::Address(0x0003), modbus::tcp::NumBits(10), req);
+            m_inputs = m_poller->addPollTask(req, make_millisecs(50));
+        }
+
+        void start() {
+            m_server.start(make_endpoint("127.0.0.1", 8502), []() {});
+            m_poller->start();
+
+            m_timer.expires_from_now(make_millisecs(300));
+            m_timer.async_wait([this](const boost::system::error_code& /*ec*/) {
+                m_poller->cancel();
+                m_poller = nullptr;
+                m_server.stop();
+            });
+
+            m_io.run();
+
+            std::vector<uint16_t> values;
+            REQUIRE(m_registers->read(values) >= 2);
+            REQUIRE(values == (std::vector<uint16_t>{0x0100, 0x0101, 0x0102}));
+            REQUIRE(m_inputs->read(values) >= 2);
+            REQUIRE(values == (std::vector<uint16_t>{0, 1, 0, 0, 1, 0, 0, 1, 0, 0}));
+        }
+
+    protected:
+        uint16_t getInputRegister(const modbus::tcp::Address& addr) const override {
+            return addr.get();
+        }
+
+        bool getDiscreteInput(const modbus::tcp::Address& addr) const override {
+            return addr.get() % 3 == 1;
+        }
+
+    private:
+        boost::asio::io_service                 m_io;
+        modbus::tcp::Server                     m_server;
+        std::shared_ptr<ModbusPoller>           m_poller;
+        boost::asio::deadline_timer             m_timer;
+        std::shared_ptr<ModbusRegisterImage>    m_registers;
+        std::shared_ptr<ModbusRegisterImage>    m_inputs;
+    };
+
+    MyTest test;
+    test.start();
+}
+
+
+TEST_CASE("ModbusPoller - round trips are recorded into metrics", "[ModbusPoller]") {
+    class MyTest : public modbus::tcp::ServerDevice {
+    public:
+        MyTest() :
+            modbus::tcp::ServerDevice(modbus::tcp::UnitId(0xab)),
+            m_metrics(),
+            m_io(),
+            m_server(m_io, *this),
+            m_poller(std::make_shared<ModbusPoller>(m_io, make_endpoint("127.0.0.1", 8502), make_millisecs(100))),
+            m_timer(m_io)
+        {
+            std::vector<uint8_t> req;
+            modbus::tcp::Encoder encoder(modbus::tcp::UnitId(0xab), modbus::tcp::TransactionId(0x0001));
+
+            encoder.encodeReadInputRegistersReq(modbus::tcp::Address(0x0100), modbus::tcp::NumRegs(3), req);
+            m_poller->addPollTask(req, make_millisecs(50));
+            m_poller->setMetrics(&m_metrics);
+            m_server.setMetrics(&m_metrics);
+        }
+
+        void start() {
+            m_server.start(make_endpoint("127.0.0.1", 8502), []() {});
+            m_poller->start();
+
+            m_timer.expires_from_now(make_millisecs(300));
+            m_timer.async_wait([this](const boost::system::error_code& /*ec*/) {
+                m_poller->cancel();
+                m_poller = nullptr;
+                m_server.stop();
+            });
+
+            m_io.run();
+
+            const modbus::MetricsSnapshot snapshot = m_metrics.getSnapshot();
+            const auto& polled = snapshot.polled.at(0x04);
+            const auto& served = snapshot.served.at(0x04);
+
+            REQUIRE(polled.requests >= 2);
+            REQUIRE(polled.exceptions == 0);
+            REQUIRE(polled.bytesSent == polled.requests * 12);
+            REQUIRE(polled.bytesReceived == polled.requests * 15);
+            REQUIRE(polled.latency.getCount() == polled.requests);
+            REQUIRE(served.requests >= polled.requests);
+            REQUIRE(polled.latency.getPercentile(0.5) >= served.latency.getPercentile(0.5));
+        }
+
+    protected:
+        uint16_t getInputRegister(const modbus::tcp::Address& addr) const override {
+            return addr.get();
+        }
+
+    private:
+        modbus::Metrics                         m_metrics;
+        boost::asio::io_service                 m_io;
+        modbus::tcp::Server                     m_server;
+        std::shared_ptr<ModbusPoller>           m_poller;
+        boost::asio::deadline_timer             m_timer;
+    };
+
+    MyTest test;
+    test.start();
+}
+
+
+TEST_CASE("ModbusPollerPool - pollers are sharded across threads", "[ModbusPollerPool]") {
+    class Device : public modbus::tcp::ServerDevice {
+    public:
+        Device() : modbus::tcp::ServerDevice(modbus::tcp::UnitId(0)) {}
+    protected:
+        uint16_t getHoldingRegister(const modbus::tcp::Address& addr) const override {
+            return addr.get();
+        }
+    };
+
+    Device                      device;
+    boost::asio::io_service     serverIo;
+    modbus::tcp::Server         server(serverIo, device);
+
+    server.start(make_endpoint("127.0.0.1", 8503), []() {});
+    std::thread serverThread([&serverIo]() { serverIo.run(); });
+
+    ModbusPollerPool pool(2);
+    std::vector<std::shared_ptr<ModbusRegisterImage>> images;
+
+    for (uint16_t i = 0; i < 4; ++i) {
+        std::vector<uint8_t> req;
+        modbus::tcp::Encoder encoder(modbus::tcp::UnitId(i + 1), modbus::tcp::TransactionId(0x0001));
+        encoder.encodeReadHoldingRegistersReq(modbus::tcp::Address(10 * i), modbus::tcp::NumRegs(2), req);
+
+        auto poller = pool.addPoller(make_endpoint("127.0.0.1", 8503), make_millisecs(100));
+        images.push_back(poller->addPollTask(req, make_millisecs(20)));
+    }
+
+    pool.start();
+
+    for (int i = 0; i < 500; ++i) {
+        if (std::all_of(images.begin(), images.end(), [](const std::shared_ptr<ModbusRegisterImage>& image) { return image->getVersion() >= 3; }))
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ModbusPollerPool::Stats stats = pool.getStats();
+    pool.stop();
+
+    server.stop();
+    serverThread.join();
+
+    REQUIRE(stats.numPollers == 4);
+    REQUIRE(stats.pollersPerThread == (std::vector<std::size_t>{2, 2}));
+    REQUIRE(stats.totals.numResponses >= 12);
+    REQUIRE(stats.totals.numConnectionErrors == 0);
+
+    for (uint16_t i = 0; i < 4; ++i) {
+        std::vector<uint16_t> values;
+        images[i]->read(values);
+        REQUIRE(values == (std::vector<uint16_t>{static_cast<uint16_t>(10 * i), static_cast<uint16_t>(10 * i + 1)}));
+    }
+}
+
+
+TEST_CASE("ModbusPollerPool - start after stop restarts the pollers", "[ModbusPollerPool]") {
+    class Device : public modbus::tcp::ServerDevice {
+    public:
+        Device() : modbus::tcp::ServerDevice(modbus::tcp::UnitId(0)) {}
+    protected:
+        uint16_t getHoldingRegister(const modbus::tcp::Address& addr) const override {
+            return addr.get();
+        }
+    };
+
+    Device                      device;
+    boost::asio::io_service     serverIo;
+    modbus::tcp::Server         server(serverIo, device);
+
+    server.start(make_endpoint("127.0.0.1", 8504), []() {});
+    std::thread serverThread([&serverIo]() { serverIo.run(); });
+
+    auto waitForVersion = [](const ModbusRegisterImage& image, uint64_t version) {
+        for (int i = 0; i < 500 && image.getVersion() < version; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        return image.getVersion() >= version;
+    };
+
+    ModbusPollerPool pool(1);
+    std::vector<uint8_t> req;
+    modbus::tcp::Encoder encoder(modbus::tcp::UnitId(1), modbus::tcp::TransactionId(0x0001));
+    encoder.encodeReadHoldingRegistersReq(modbus::tcp::Address(10), modbus::tcp::NumRegs(2), req);
+
+    auto poller = pool.addPoller(make_endpoint("127.0.0.1", 8504), make_millisecs(100));
+    auto image = poller->addPollTask(req, make_millisecs(20));
+
+    pool.start();
+    REQUIRE(waitForVersion(*image, 3));
+    pool.stop();
+
+    uint64_t stoppedVersion = image->getVersion();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(image->getVersion() == stoppedVersion);
+
+    pool.start();
+    bool resumed = waitForVersion(*image, stoppedVersion + 3);
+    pool.stop();
+
+    server.stop();
+    serverThread.join();
+
+    REQUIRE(resumed);
+    REQUIRE(pool.getStats().totals.numConnectionErrors == 0);
+}
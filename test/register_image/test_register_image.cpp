@@ -0,0 +1,79 @@
+#define CATCH_CONFIG_MAIN
+
+#include "Catch.hpp"
+#include "ModbusRegisterImage.hpp"
+
+#include <thread>
+#include <algorithm>
+
+
+TEST_CASE("ModbusRegisterImage - initially zeroed and unpublished", "[ModbusRegisterImage]") {
+    ModbusRegisterImage image(4);
+    std::vector<uint16_t> values;
+
+    REQUIRE(image.size() == 4);
+    REQUIRE(image.getVersion() == 0);
+    REQUIRE(image.read(values) == 0);
+    REQUIRE(values == (std::vector<uint16_t>{0, 0, 0, 0}));
+}
+
+
+TEST_CASE("ModbusRegisterImage - publish bumps the version", "[ModbusRegisterImage]") {
+    ModbusRegisterImage image(3);
+    std::vector<uint16_t> values;
+
+    const uint16_t first[] = {1, 2, 3};
+    image.publish(first);
+    REQUIRE(image.read(values) == 1);
+    REQUIRE(values == (std::vector<uint16_t>{1, 2, 3}));
+
+    image.beginUpdate();
+    image.set(1, 0xabcd);
+    image.endUpdate();
+
+    REQUIRE(image.getVersion() == 2);
+    REQUIRE(image.read(values) == 2);
+    REQUIRE(values == (std::vector<uint16_t>{1, 0xabcd, 3}));
+}
+
+
+TEST_CASE("ModbusRegisterImage - readers never observe a torn snapshot", "[ModbusRegisterImage]") {
+    ModbusRegisterImage image(125);
+    std::atomic<bool> done(false);
+    std::atomic<std::size_t> numTornReads(0);
+
+    std::thread writer([&image, &done]() {
+        std::vector<uint16_t> values(image.size());
+
+        for (uint16_t i = 1; i <= 20000; ++i) {
+            std::fill(values.begin(), values.end(), i);
+            image.publish(values.data());
+        }
+
+        done = true;
+    });
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&image, &done, &numTornReads]() {
+            std::vector<uint16_t> values;
+            uint64_t lastVersion = 0;
+
+            while (!done) {
+                uint64_t version = image.read(values);
+
+                if (version < lastVersion || std::count(values.begin(), values.end(), values.front()) != static_cast<long>(values.size()))
+                    numTornReads++;
+
+                lastVersion = version;
+            }
+        });
+    }
+
+    writer.join();
+    for (auto& reader: readers)
+        reader.join();
+
+    REQUIRE(numTornReads == 0);
+    REQUIRE(image.getVersion() == 20000);
+}
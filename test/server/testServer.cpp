@@ -12,6 +12,9 @@
 #include "ModbusEncoder.hpp"
 #include "ModbusServerDevice.hpp"
 #include "ModbusServer.hpp"
+#include "ModbusServerPool.hpp"
+#include "ModbusMemoryServerDevice.hpp"
+#include "ModbusHandlerAllocator.hpp"
 
 class ServerDevice : public modbus::tcp::ServerDevice {
 public:
@@ -61,3 +64,491 @@ TEST_CASE("server must respond to read coils req", "[server]") {
     REQUIRE(serverDone == true);
     REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x81, 0x01}));
 }
+
+
+TEST_CASE("server pool must serve clients from all threads", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    const uint16_t reg = 0x1234;
+    dev.storeHoldingRegisters(mt::Address(0x1020), &reg, 1);
+
+    mt::ServerPool pool(4, dev);
+    REQUIRE(pool.getNumThreads() == 4);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50001);
+    pool.start(ep);
+
+    boost::asio::io_service io;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> clients;
+
+    for (int i = 0; i < 8; ++i) {
+        clients.emplace_back(new boost::asio::ip::tcp::socket(io));
+        clients.back()->connect(ep);
+    }
+
+    for (auto& client: clients) {
+        std::vector<uint8_t> req;
+        mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+        encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020), mt::NumRegs(1), req);
+
+        boost::asio::write(*client, boost::asio::buffer(req));
+
+        std::vector<uint8_t> rsp(11);
+        boost::asio::read(*client, boost::asio::buffer(rsp));
+
+        REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x12, 0x34}));
+    }
+
+    pool.stop();
+}
+
+
+TEST_CASE("server pool must report bind failures from start", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    mt::ServerPool pool(2, dev);
+
+    // bound without SO_REUSEPORT, so none of the pool's acceptors may share the port
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50009);
+    boost::asio::io_service io;
+    boost::asio::ip::tcp::acceptor blocker(io, ep);
+
+    REQUIRE_THROWS_AS(pool.start(ep), boost::system::system_error);
+
+    blocker.close();
+    pool.start(ep);
+
+    boost::asio::ip::tcp::socket client(io);
+    client.connect(ep);
+    client.close();
+
+    pool.stop();
+}
+
+
+TEST_CASE("server must answer pipelined requests in order", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    const uint16_t regs[] = {0x0001, 0x0002, 0x0003};
+    dev.storeHoldingRegisters(mt::Address(0x1020), regs, 3);
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50002);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    boost::asio::io_service clientIo;
+    boost::asio::ip::tcp::socket client(clientIo);
+    client.connect(ep);
+
+    // all requests in a single segment, the responses must come back in request order
+    std::vector<uint8_t> reqs;
+
+    for (uint16_t i = 0; i < 3; ++i) {
+        std::vector<uint8_t> req;
+        mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(i));
+        encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020 + i), mt::NumRegs(1), req);
+        reqs.insert(reqs.end(), req.begin(), req.end());
+    }
+
+    boost::asio::write(client, boost::asio::buffer(reqs));
+
+    std::vector<uint8_t> rsp(3 * 11);
+    boost::asio::read(client, boost::asio::buffer(rsp));
+
+    REQUIRE(rsp == (std::vector<uint8_t>{
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x01,
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x02,
+        0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x03}));
+
+    server.stop();
+    serverThread.join();
+}
+
+
+TEST_CASE("server must reassemble requests split across segments", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    const uint16_t regs[] = {0x0001, 0x0002};
+    dev.storeHoldingRegisters(mt::Address(0x1020), regs, 2);
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50003);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    boost::asio::io_service clientIo;
+    boost::asio::ip::tcp::socket client(clientIo);
+    client.connect(ep);
+    client.set_option(boost::asio::ip::tcp::no_delay(true));
+
+    std::vector<uint8_t> reqs;
+
+    for (uint16_t i = 0; i < 2; ++i) {
+        std::vector<uint8_t> req;
+        mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(i));
+        encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020 + i), mt::NumRegs(1), req);
+        reqs.insert(reqs.end(), req.begin(), req.end());
+    }
+
+    // first request cut within the header, the rest of it sent together with the second one
+    boost::asio::write(client, boost::asio::buffer(reqs.data(), 5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    boost::asio::write(client, boost::asio::buffer(reqs.data() + 5, reqs.size() - 5));
+
+    std::vector<uint8_t> rsp(2 * 11);
+    boost::asio::read(client, boost::asio::buffer(rsp));
+
+    REQUIRE(rsp == (std::vector<uint8_t>{
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x01,
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x02}));
+
+    server.stop();
+    serverThread.join();
+}
+
+
+TEST_CASE("server must serve reconnecting clients with recycled sessions", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    const uint16_t reg = 0x4321;
+    dev.storeHoldingRegisters(mt::Address(0x1020), &reg, 1);
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50004);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<uint8_t> req;
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x07));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020), mt::NumRegs(1), req);
+
+    for (int i = 0; i < 5; ++i) {
+        boost::asio::io_service clientIo;
+        boost::asio::ip::tcp::socket client(clientIo);
+        client.connect(ep);
+
+        boost::asio::write(client, boost::asio::buffer(req));
+
+        std::vector<uint8_t> rsp(11);
+        boost::asio::read(client, boost::asio::buffer(rsp));
+
+        REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x07, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x43, 0x21}));
+
+        client.close();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+
+TEST_CASE("handler memory hands out its block once at a time", "[server]") {
+    modbus::tcp::HandlerMemory memory;
+
+    void* first = memory.allocate(64);
+    void* second = memory.allocate(64);
+
+    REQUIRE(first != second);
+
+    memory.deallocate(second);
+    memory.deallocate(first);
+
+    REQUIRE(memory.allocate(64) == first);
+
+    void* large = memory.allocate(4096);
+    REQUIRE(large != first);
+    memory.deallocate(large);
+}
+
+
+TEST_CASE("server must enforce session and request limits", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+
+    mt::Server::Limits limits;
+    limits.maxSessionsPerClient = 1;
+    limits.maxRequestRate = 0.001;
+    limits.requestBurst = 2;
+    server.setLimits(limits);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50005);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    boost::asio::io_service clientIo;
+    boost::asio::ip::tcp::socket client(clientIo);
+    client.connect(ep);
+
+    // a second connection from the same address is closed right away
+    boost::asio::ip::tcp::socket rejected(clientIo);
+    rejected.connect(ep);
+
+    uint8_t byte;
+    boost::system::error_code ec;
+    boost::asio::read(rejected, boost::asio::buffer(&byte, 1), ec);
+
+    REQUIRE(ec == boost::asio::error::eof);
+
+    // the burst is served, the request beyond it is answered with SLAVE_DEVICE_BUSY
+    std::vector<uint8_t> reqs;
+
+    for (uint16_t i = 0; i < 3; ++i) {
+        std::vector<uint8_t> req;
+        mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(i));
+        encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020), mt::NumRegs(1), req);
+        reqs.insert(reqs.end(), req.begin(), req.end());
+    }
+
+    boost::asio::write(client, boost::asio::buffer(reqs));
+
+    std::vector<uint8_t> rsp(2 * 11 + 9);
+    boost::asio::read(client, boost::asio::buffer(rsp));
+
+    REQUIRE(rsp == (std::vector<uint8_t>{
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x00,
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x00,
+        0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x83, 0x06}));
+
+    server.stop();
+    serverThread.join();
+}
+
+
+TEST_CASE("server must close idle connections and stalled frames", "[server]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+
+    mt::Server::Limits limits;
+    limits.idleTimeout = mt::TimingWheel::Interval(300);
+    limits.frameTimeout = mt::TimingWheel::Interval(100);
+    server.setLimits(limits);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50006);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    boost::asio::io_service clientIo;
+    boost::asio::ip::tcp::socket idle(clientIo);
+    boost::asio::ip::tcp::socket stalled(clientIo);
+    idle.connect(ep);
+    stalled.connect(ep);
+
+    const uint8_t partialHeader[] = {0x00, 0x01, 0x00};
+    boost::asio::write(stalled, boost::asio::buffer(partialHeader));
+
+    uint8_t byte;
+    boost::system::error_code ec;
+    auto start = std::chrono::steady_clock::now();
+
+    boost::asio::read(stalled, boost::asio::buffer(&byte, 1), ec);
+    auto stalledClosed = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(ec == boost::asio::error::eof);
+
+    boost::asio::read(idle, boost::asio::buffer(&byte, 1), ec);
+    auto idleClosed = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(ec == boost::asio::error::eof);
+    REQUIRE(stalledClosed < std::chrono::milliseconds(300));
+    REQUIRE(idleClosed >= std::chrono::milliseconds(300));
+
+    server.stop();
+    serverThread.join();
+}
+
+
+TEST_CASE("server must close connections of clients that do not read", "[server]") {
+    namespace mt = modbus::tcp;
+
+    modbus::Metrics metrics;
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+    server.setMetrics(&metrics);
+
+    mt::Server::Limits limits;
+    limits.idleTimeout = mt::TimingWheel::Interval(200);
+    server.setLimits(limits);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50008);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // requests for large responses, sent until the server stops reading
+    std::vector<uint8_t> req, requests;
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x01));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0000), mt::NumRegs(125), req);
+
+    for (int i = 0; i < 1000; ++i)
+        requests.insert(requests.end(), req.begin(), req.end());
+
+    boost::asio::io_service clientIo;
+    boost::asio::ip::tcp::socket client(clientIo);
+    client.open(ep.protocol());
+    client.set_option(boost::asio::socket_base::receive_buffer_size(4096));
+    client.connect(ep);
+    client.non_blocking(true);
+
+    boost::system::error_code ec;
+    auto start = std::chrono::steady_clock::now();
+
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        client.write_some(boost::asio::buffer(requests), ec);
+
+        if (ec == boost::asio::error::would_block)
+            break;
+
+        REQUIRE(!ec);
+    }
+
+    REQUIRE(ec == boost::asio::error::would_block);
+
+    // reception is paused behind the stuck write, the idle timeout must still reclaim the session
+    bool closed = false;
+
+    for (int i = 0; i < 200 && !closed; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        closed = metrics.getSnapshot().connections.empty();
+    }
+
+    REQUIRE(closed);
+
+    client.close();
+    server.stop();
+    serverThread.join();
+}
+
+
+TEST_CASE("timing wheel fires scheduled entries once", "[server]") {
+    namespace mt = modbus::tcp;
+
+    boost::asio::io_service io;
+    mt::TimingWheel wheel(io, mt::TimingWheel::Interval(10), 4);
+
+    int numFired[3] = {0, 0, 0};
+    mt::TimingWheel::Entry short_(  [&numFired]() { ++numFired[0]; });
+    mt::TimingWheel::Entry long_(   [&numFired]() { ++numFired[1]; });
+    mt::TimingWheel::Entry cancelled([&numFired]() { ++numFired[2]; });
+
+    wheel.schedule(short_, mt::TimingWheel::Interval(10));
+    wheel.schedule(long_, mt::TimingWheel::Interval(100));     // more than one turn of the wheel
+    wheel.schedule(cancelled, mt::TimingWheel::Interval(10));
+    wheel.cancel(cancelled);
+
+    auto start = std::chrono::steady_clock::now();
+    io.run();
+
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100));
+    REQUIRE(numFired[0] == 1);
+    REQUIRE(numFired[1] == 1);
+    REQUIRE(numFired[2] == 0);
+    REQUIRE(!long_.isScheduled());
+}
+
+
+TEST_CASE("timing wheel may be destroyed while its tick is pending", "[server]") {
+    namespace mt = modbus::tcp;
+
+    boost::asio::io_service io;
+    int numFired = 0;
+    mt::TimingWheel::Entry entry([&numFired]() { ++numFired; });
+
+    // the io_service keeps running after the wheel is gone, its aborted wait must not touch it
+    std::unique_ptr<mt::TimingWheel> wheel(new mt::TimingWheel(io, mt::TimingWheel::Interval(10), 4));
+    wheel->schedule(entry, mt::TimingWheel::Interval(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    wheel.reset();
+    io.run();
+
+    REQUIRE(numFired == 0);
+    REQUIRE(!entry.isScheduled());
+}
+
+
+TEST_CASE("server must record requests into metrics", "[server]") {
+    namespace mt = modbus::tcp;
+
+    modbus::Metrics metrics;
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+
+    boost::asio::io_service io;
+    mt::Server server(io, dev);
+    server.setMetrics(&metrics);
+
+    const boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 50007);
+    server.start(ep, []() {});
+    std::thread serverThread([&io]() { io.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<uint8_t> req;
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x01));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0000), mt::NumRegs(1), req);
+
+    // unknown function code 0x07, answered with an exception
+    const std::vector<uint8_t> unknown{0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0xab, 0x07};
+    req.insert(req.end(), unknown.begin(), unknown.end());
+
+    boost::asio::io_service clientIo;
+    boost::asio::ip::tcp::socket client(clientIo);
+    client.connect(ep);
+    boost::asio::write(client, boost::asio::buffer(req));
+
+    std::vector<uint8_t> rsp(11 + 9);
+    boost::asio::read(client, boost::asio::buffer(rsp));
+
+    modbus::MetricsSnapshot snapshot = metrics.getSnapshot();
+
+    REQUIRE(snapshot.connections.size() == 1);
+    REQUIRE(snapshot.connections[0].requests == 2);
+    REQUIRE(snapshot.connections[0].exceptions == 1);
+    REQUIRE(snapshot.connections[0].bytesReceived == req.size());
+    REQUIRE(snapshot.connections[0].bytesSent == rsp.size());
+
+    client.close();
+    server.stop();
+    serverThread.join();
+
+    snapshot = metrics.getSnapshot();
+
+    REQUIRE(snapshot.connections.empty());
+    REQUIRE(snapshot.served.at(0x03).requests == 1);
+    REQUIRE(snapshot.served.at(0x03).exceptions == 0);
+    REQUIRE(snapshot.served.at(0x03).latency.getCount() == 1);
+    REQUIRE(snapshot.served.at(0x07).requests == 1);
+    REQUIRE(snapshot.served.at(0x07).exceptions == 1);
+}
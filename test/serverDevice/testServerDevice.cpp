@@ -5,6 +5,11 @@
 #include "ModbusEncoder.hpp"
 #include "ModbusDecoder.hpp"
 #include "ModbusServerDevice.hpp"
+#include "ModbusMemoryServerDevice.hpp"
+#include "ModbusServerDeviceRouter.hpp"
+
+#include <atomic>
+#include <thread>
 
 class TestServerDevice : public modbus::tcp::ServerDevice {
 public:
@@ -113,3 +118,405 @@ TEST_CASE("handle read coils - bad number of requested coils") {
     mt::decoder_views::ErrorResponse rsp_payload_view(rsp);
     REQUIRE(rsp_payload_view.getCode() == mt::ExceptionCode::ILLEGAL_DATA_VALUE);
 }
+
+
+TEST_CASE("handle request with unknown function code") {
+    namespace mt = modbus::tcp;
+
+    TestServerDevice dev(mt::UnitId(0xab), [](uint16_t /*address*/)->bool {
+        return true;
+    });
+
+    std::vector<uint8_t> req{0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x2b, 0x10, 0x20, 0x00, 0x04};
+    std::vector<uint8_t> rsp;
+
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0xab, 0x01}));
+}
+
+
+TEST_CASE("handle truncated request") {
+    namespace mt = modbus::tcp;
+
+    TestServerDevice dev(mt::UnitId(0xab), [](uint16_t /*address*/)->bool {
+        return true;
+    });
+
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp{0x01};
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    encoder.encodeReadCoilsReq(mt::Address(0x1020), mt::NumBits(4), req);
+    req.pop_back();
+
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp.empty());
+}
+
+
+TEST_CASE("handle read holding registers - status based device") {
+    namespace mt = modbus::tcp;
+
+    class StatusDevice : public mt::ServerDevice {
+    public:
+        StatusDevice() : mt::ServerDevice(mt::UnitId(0xab)) {}
+
+    protected:
+        mt::Status readHoldingRegister(const mt::Address& address, uint16_t& value) const override {
+            if (address.get() >= 0x1022)
+                return mt::Status::ILLEGAL_DATA_ADDRESS;
+
+            value = address.get();
+            return mt::Status::OK;
+        }
+    };
+
+    StatusDevice dev;
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020), mt::NumRegs(2), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x03, 0x04, 0x10, 0x20, 0x10, 0x21}));
+
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020), mt::NumRegs(3), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x83, 0x02}));
+
+    encoder.encodeReadInputRegistersReq(mt::Address(0x1020), mt::NumRegs(3), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x84, 0x01}));
+}
+
+
+TEST_CASE("handle unsupported function codes - no exception thrown") {
+    namespace mt = modbus::tcp;
+
+    // forwards to the base getter and records whether it returned instead of throwing
+    class PartialDevice : public mt::ServerDevice {
+    public:
+        PartialDevice() : mt::ServerDevice(mt::UnitId(0xab)), m_baseReturned(false) {}
+
+        uint16_t callBase(const mt::Address& address) const {
+            return mt::ServerDevice::getHoldingRegister(address);
+        }
+
+        mutable bool m_baseReturned;
+
+    protected:
+        uint16_t getHoldingRegister(const mt::Address& address) const override {
+            uint16_t value = mt::ServerDevice::getHoldingRegister(address);
+            m_baseReturned = true;
+            return value;
+        }
+    };
+
+    PartialDevice dev;
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x1020), mt::NumRegs(2), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(dev.m_baseReturned);
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x83, 0x01}));
+
+    encoder.encodeWriteSingleCoilReq(mt::Address(0x1020), true, req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x85, 0x01}));
+
+    // outside of request handling the base getters still throw, as existing devices expect
+    REQUIRE_THROWS_AS(dev.callBase(mt::Address(0x1020)), mt::FunctionCodeNotSupported);
+}
+
+
+TEST_CASE("handle read requests - range based device") {
+    namespace mt = modbus::tcp;
+
+    class RangeDevice : public mt::ServerDevice {
+    public:
+        RangeDevice() : mt::ServerDevice(mt::UnitId(0xab)), numCalls(0) {}
+        mutable int numCalls;
+
+    protected:
+        mt::Status readInputRegisters(const mt::Address& startAddress, std::size_t count, uint16_t* values) const override {
+            ++numCalls;
+
+            for (std::size_t i = 0; i < count; ++i)
+                values[i] = startAddress.get() + i;
+
+            return mt::Status::OK;
+        }
+
+        mt::Status readDiscreteInputs(const mt::Address&, std::size_t count, uint8_t* values) const override {
+            ++numCalls;
+
+            for (std::size_t i = 0; i < count; ++i)
+                values[i] = i % 3 == 0;
+
+            return mt::Status::OK;
+        }
+    };
+
+    RangeDevice dev;
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    encoder.encodeReadInputRegistersReq(mt::Address(0x1020), mt::NumRegs(3), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0xab, 0x04, 0x06, 0x10, 0x20, 0x10, 0x21, 0x10, 0x22}));
+
+    encoder.encodeReadDiscreteInputsReq(mt::Address(0x1020), mt::NumBits(10), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x02, 0x02, 0b01001001, 0b00000010}));
+    REQUIRE(dev.numCalls == 2);
+
+    encoder.encodeReadInputRegistersReq(mt::Address(0xfffe), mt::NumRegs(3), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x84, 0x02}));
+    REQUIRE(dev.numCalls == 2);
+}
+
+
+TEST_CASE("memory device - read and write through requests", "[server device]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    const uint16_t regs[] = {0x1234, 0xabcd};
+    dev.storeHoldingRegisters(mt::Address(0x0100), regs, 2);
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0100), mt::NumRegs(2), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0xab, 0x03, 0x04, 0x12, 0x34, 0xab, 0xcd}));
+
+    const std::vector<uint16_t> written{0x0102, 0x0304};
+    encoder.encodeWriteRegistersReq(mt::Address(0xfffe), written.begin(), written.end(), req);
+    dev.handleMessage(req, rsp);
+
+    uint16_t loaded[2] = {};
+    dev.loadHoldingRegisters(mt::Address(0xfffe), 2, loaded);
+
+    REQUIRE(loaded[0] == 0x0102);
+    REQUIRE(loaded[1] == 0x0304);
+
+    const std::vector<bool> coils{1, 1, 0, 1, 0, 0, 1, 1, 1, 0, 1};
+    encoder.encodeWriteCoilsReq(mt::Address(0x003d), coils.begin(), coils.end(), req);
+    dev.handleMessage(req, rsp);
+
+    encoder.encodeReadCoilsReq(mt::Address(0x003d), mt::NumBits(11), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x01, 0x02, 0b11001011, 0b00000101}));
+
+    encoder.encodeReadCoilsReq(mt::Address(0x003e), mt::NumBits(3), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x04, 0xab, 0x01, 0x01, 0b00000101}));
+}
+
+
+TEST_CASE("memory device - bits across word boundaries", "[server device]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+
+    std::vector<uint8_t> values(200);
+    for (std::size_t i = 0; i < values.size(); ++i)
+        values[i] = (i * 7) % 5 < 2;
+
+    for (std::size_t start: {0u, 1u, 57u, 63u, 64u, 65u, 0xffffu - 200u}) {
+        dev.storeDiscreteInputs(mt::Address(start), values.data(), values.size());
+
+        std::vector<uint8_t> loaded(values.size());
+        dev.loadDiscreteInputs(mt::Address(start), loaded.size(), loaded.data());
+
+        REQUIRE(loaded == values);
+    }
+
+    REQUIRE_THROWS_AS(dev.storeDiscreteInputs(mt::Address(0xffff), values.data(), 2), std::out_of_range);
+}
+
+
+TEST_CASE("memory device - maximum size writes through requests", "[server device]") {
+    namespace mt = modbus::tcp;
+
+    mt::BasicMemoryServerDevice<mt::SeqLocking> dev(mt::UnitId(0xab));
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    std::vector<uint16_t> regs(0x7B);
+    for (std::size_t i = 0; i < regs.size(); ++i)
+        regs[i] = 0x1000 + 3*i;
+
+    encoder.encodeWriteRegistersReq(mt::Address(0x0100), regs.begin(), regs.end(), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x10, 0x01, 0x00, 0x00, 0x7B}));
+
+    std::vector<uint16_t> loadedRegs(regs.size());
+    dev.loadHoldingRegisters(mt::Address(0x0100), loadedRegs.size(), loadedRegs.data());
+    REQUIRE(loadedRegs == regs);
+
+    // coils around the written range are set beforehand and must survive the write
+    std::vector<uint8_t> ones(0x7B0 + 128, 1);
+    std::vector<uint8_t> coils(0x7B0);
+    for (std::size_t i = 0; i < coils.size(); ++i)
+        coils[i] = (i * 7) % 5 < 2;
+
+    for (std::size_t start: {64u, 67u, 0x1003u}) {
+        dev.storeCoils(mt::Address(start - 64), ones.data(), ones.size());
+
+        encoder.encodeWriteCoilsReq(mt::Address(start), coils.begin(), coils.end(), req);
+        dev.handleMessage(req, rsp);
+
+        REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0xab, 0x0f,
+                                             static_cast<uint8_t>(start >> 8), static_cast<uint8_t>(start), 0x07, 0xB0}));
+
+        std::vector<uint8_t> loaded(ones.size());
+        dev.loadCoils(mt::Address(start - 64), loaded.size(), loaded.data());
+
+        REQUIRE(std::vector<uint8_t>(loaded.begin(), loaded.begin() + 64) == std::vector<uint8_t>(64, 1));
+        REQUIRE(std::vector<uint8_t>(loaded.begin() + 64, loaded.begin() + 64 + coils.size()) == coils);
+        REQUIRE(std::vector<uint8_t>(loaded.begin() + 64 + coils.size(), loaded.end()) == std::vector<uint8_t>(64, 1));
+    }
+}
+
+
+TEST_CASE("memory device - address windows", "[server device]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev(mt::UnitId(0xab));
+    dev.setWindow(mt::MemoryServerDevice::Table::INPUT_REGISTERS, mt::Address(0x1000), 0x10);
+
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+    encoder.encodeReadInputRegistersReq(mt::Address(0x100f), mt::NumRegs(1), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x04, 0x02, 0x00, 0x00}));
+
+    encoder.encodeReadInputRegistersReq(mt::Address(0x100f), mt::NumRegs(2), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x84, 0x02}));
+
+    encoder.encodeReadInputRegistersReq(mt::Address(0x0fff), mt::NumRegs(1), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0xab, 0x84, 0x02}));
+
+    // the other tables keep the full address space
+    encoder.encodeReadHoldingRegistersReq(mt::Address(0x0000), mt::NumRegs(1), req);
+    dev.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xab, 0x03, 0x02, 0x00, 0x00}));
+}
+
+
+TEST_CASE("router - dispatch by unit id", "[server device]") {
+    namespace mt = modbus::tcp;
+
+    mt::MemoryServerDevice dev1(mt::UnitId(0x01));
+    mt::MemoryServerDevice dev2(mt::UnitId(0xc8));
+
+    const uint16_t reg1 = 0x1111;
+    const uint16_t reg2 = 0x2222;
+    dev1.storeHoldingRegisters(mt::Address(0x0010), &reg1, 1);
+    dev2.storeHoldingRegisters(mt::Address(0x0010), &reg2, 1);
+
+    mt::ServerDeviceRouter router;
+    router.addDevice(dev1);
+    router.addDevice(dev2);
+
+    REQUIRE_THROWS_AS(router.addDevice(dev1), std::logic_error);
+
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> rsp;
+
+    mt::Encoder(mt::UnitId(0x01), mt::TransactionId(0x02)).encodeReadHoldingRegistersReq(mt::Address(0x0010), mt::NumRegs(1), req);
+    router.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0x01, 0x03, 0x02, 0x11, 0x11}));
+
+    mt::Encoder(mt::UnitId(0xc8), mt::TransactionId(0x03)).encodeReadHoldingRegistersReq(mt::Address(0x0010), mt::NumRegs(1), req);
+    router.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x03, 0x00, 0x00, 0x00, 0x05, 0xc8, 0x03, 0x02, 0x22, 0x22}));
+
+    router.removeDevice(mt::UnitId(0xc8));
+    router.handleMessage(req, rsp);
+
+    REQUIRE(rsp == (std::vector<uint8_t>{0x00, 0x03, 0x00, 0x00, 0x00, 0x03, 0xc8, 0x83, 0x0b}));
+
+    req.resize(5);
+    router.handleMessage(req, rsp);
+
+    REQUIRE(rsp.empty());
+}
+
+
+TEST_CASE("memory device - seqlock readers never see partial writes", "[server device]") {
+    namespace mt = modbus::tcp;
+
+    mt::BasicMemoryServerDevice<mt::SeqLocking> dev(mt::UnitId(0xab));
+    std::atomic<bool> done(false);
+    std::atomic<int> numTornReads(0);
+
+    std::thread writer([&]() {
+        std::vector<uint16_t> regs(mt::MODBUS_MAX_NUM_REGS_IN_READ_REQUEST);
+
+        for (uint16_t i = 0; !done; ++i) {
+            std::fill(regs.begin(), regs.end(), i);
+            dev.storeHoldingRegisters(mt::Address(0x0100), regs.data(), regs.size());
+        }
+    });
+
+    std::vector<std::thread> readers;
+
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&]() {
+            std::vector<uint8_t> req;
+            std::vector<uint8_t> rsp;
+
+            mt::Encoder encoder(mt::UnitId(0xab), mt::TransactionId(0x02));
+            encoder.encodeReadHoldingRegistersReq(mt::Address(0x0100), mt::NumRegs(mt::MODBUS_MAX_NUM_REGS_IN_READ_REQUEST), req);
+
+            for (int i = 0; i < 20000; ++i) {
+                dev.handleMessage(req, rsp);
+
+                for (std::size_t i = 11; i < rsp.size(); i += 2) {
+                    if (rsp[i] != rsp[9] || rsp[i + 1] != rsp[10])
+                        ++numTornReads;
+                }
+            }
+        });
+    }
+
+    for (auto& reader: readers)
+        reader.join();
+
+    done = true;
+    writer.join();
+
+    REQUIRE(numTornReads == 0);
+}